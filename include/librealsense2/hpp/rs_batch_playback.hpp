@@ -0,0 +1,252 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2017 Intel Corporation. All Rights Reserved.
+
+#ifndef LIBREALSENSE_RS2_BATCH_PLAYBACK_HPP
+#define LIBREALSENSE_RS2_BATCH_PLAYBACK_HPP
+
+#include <map>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <exception>
+#include <condition_variable>
+#include "../rs.hpp"
+#include "rs_platform.hpp"
+
+namespace rs2
+{
+    /**
+    * Reprocesses recordings as fast as the machine allows, e.g. to rerun a changed tracker over a set of recorded .bag files.
+    * Every file is played back in non-real-time mode, so that no frame is dropped and playback runs at the speed of
+    * the processing rather than of the clock. The SDK reads and decodes the file on its own thread while the frames
+    * read ahead wait in a bounded queue for the processing thread, and several files are processed in parallel.
+    *
+    * Frames reach the handler in a deterministic order: sorted by timestamp, ties broken by stream, regardless of how the
+    * threads of the SDK interleave. The order is exact as long as no stream runs ahead of the others by more than
+    * the read-ahead depth, in which case the frames read ahead are released to keep the playback going.
+    */
+    class batch_playback
+    {
+    public:
+        struct result
+        {
+            std::string file;
+            uint64_t frames;            // Frames passed to the handler
+            double seconds;             // Time spent on the file
+            double recorded_seconds;    // Duration of the recording
+            std::string error;          // Empty if the file was processed to its end
+        };
+
+        /**
+        * \param[in] parallel_files   Files processed at the same time, 0 for one per pair of cores
+        * \param[in] read_ahead       Frames per stream decoded ahead of the processing
+        */
+        explicit batch_playback(size_t parallel_files = 0, size_t read_ahead = 8)
+            : _parallel_files(parallel_files), _read_ahead(std::max<size_t>(read_ahead, 1))
+        {}
+
+        /**
+        * Process the files
+        * \param[in] files          Recordings to process
+        * \param[in] make_handler   Called with the name of every file on the thread that processes it, returns the
+        *                           callable that receives the frames of that file. Calls are serialized, so it may
+        *                           update shared state without locking. Handlers are not shared between files, so
+        *                           stateful filters such as the temporal filter can be used without locking
+        * \return Result for every file, in the order of the files
+        */
+        template<class F>
+        std::vector<result> run(const std::vector<std::string>& files, F make_handler) const
+        {
+            std::vector<result> results(files.size());
+            std::atomic<size_t> next{ 0 };
+            std::mutex factory;
+            auto work = [&]() {
+                for (size_t i = next++; i < files.size(); i = next++)
+                    results[i] = play(files[i], make_handler, factory);
+            };
+
+            size_t threads = _parallel_files ? _parallel_files : std::max(1u, std::thread::hardware_concurrency() / 2);
+            threads = std::min(threads, files.size());
+            std::vector<std::thread> workers;
+            for (size_t t = 1; t < threads; ++t)
+                workers.emplace_back(work);
+            work();
+            for (auto& w : workers) w.join();
+            return results;
+        }
+
+        /**
+        * Files in a directory with the given extension, sorted by name
+        */
+        static std::vector<std::string> list_recordings(const std::string& directory, const std::string& extension = ".bag")
+        {
+            auto names = platform::list_files(directory, extension);
+            std::sort(names.begin(), names.end());
+            for (auto& n : names) n = directory + "/" + n;
+            return names;
+        }
+
+    private:
+        // Streams of one recording merged into timestamp order
+        class merge_queue
+        {
+        public:
+            explicit merge_queue(size_t depth) : _depth(depth) {}
+
+            void add_stream(int uid)
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _streams[uid];
+            }
+
+            // Called on the threads of the SDK. Holds the playback back while the stream's queue is full
+            void push(frame f)
+            {
+                const double timestamp = f.get_timestamp();
+                const int uid = f.get_profile().unique_id();
+                std::unique_lock<std::mutex> lock(_mutex);
+                auto& q = _streams[uid];
+                _not_full.wait(lock, [&] { return _finished || q.size() < _depth; });
+                q.push_back({ timestamp, std::move(f) });
+                lock.unlock();
+                _not_empty.notify_one();
+            }
+
+            // The playback reached the end of the file
+            void finish()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    _finished = true;
+                }
+                _not_empty.notify_all();
+                _not_full.notify_all();
+            }
+
+            // Take the earliest frame once every stream has a frame waiting, so that no earlier frame can still arrive.
+            // Returns false once the playback finished and all frames were taken
+            bool pop(frame& f)
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                for (;;)
+                {
+                    std::deque<entry>* earliest = nullptr;
+                    bool all = true, full = false;
+                    for (auto& s : _streams)
+                    {
+                        auto& q = s.second;
+                        if (q.empty())
+                        {
+                            all = false;
+                            continue;
+                        }
+                        full |= q.size() >= _depth;
+                        if (!earliest || q.front().timestamp < earliest->front().timestamp)
+                            earliest = &q;
+                    }
+                    if (earliest && (all || full || _finished))
+                    {
+                        f = std::move(earliest->front().f);
+                        earliest->pop_front();
+                        lock.unlock();
+                        _not_full.notify_all();
+                        return true;
+                    }
+                    if (!earliest && _finished) return false;
+                    _not_empty.wait(lock);
+                }
+            }
+
+        private:
+            struct entry
+            {
+                double timestamp;
+                frame f;
+            };
+
+            std::mutex _mutex;
+            std::condition_variable _not_empty;
+            std::condition_variable _not_full;
+            std::map<int, std::deque<entry>> _streams;  // Ordered by stream, which breaks timestamp ties
+            size_t _depth;
+            bool _finished = false;
+        };
+
+        template<class F>
+        result play(const std::string& file, F& make_handler, std::mutex& factory) const
+        {
+            result r{ file, 0, 0, 0, "" };
+            const auto started = std::chrono::steady_clock::now();
+            try
+            {
+                context ctx;
+                playback dev = ctx.load_device(file);
+                dev.set_real_time(false);
+                r.recorded_seconds = std::chrono::duration<double>(dev.get_duration()).count();
+
+                auto handler = [&]() {
+                    std::lock_guard<std::mutex> lock(factory);
+                    return make_handler(file);
+                }();
+                auto queue = std::make_shared<merge_queue>(_read_ahead);
+                dev.set_status_changed_callback([queue](rs2_playback_status status) {
+                    if (status == RS2_PLAYBACK_STATUS_STOPPED) queue->finish();
+                });
+
+                std::vector<sensor> started_sensors;
+                for (auto&& s : dev.query_sensors())
+                {
+                    auto profiles = s.get_stream_profiles();
+                    if (profiles.empty()) continue;
+                    for (auto& p : profiles) queue->add_stream(p.unique_id());
+                    s.open(profiles);
+                    started_sensors.push_back(s);
+                }
+                for (auto& s : started_sensors)
+                    s.start([queue](frame f) { queue->push(std::move(f)); });
+
+                std::exception_ptr failure;
+                try
+                {
+                    frame f;
+                    while (queue->pop(f))
+                    {
+                        handler(f);
+                        ++r.frames;
+                    }
+                }
+                catch (...)
+                {
+                    failure = std::current_exception();
+                }
+
+                // Release the playback if the handler failed half way; at the end of the file it stopped its sensors already
+                queue->finish();
+                for (auto& s : started_sensors)
+                {
+                    try { s.stop(); } catch (const error&) {}
+                    try { s.close(); } catch (const error&) {}
+                }
+                ctx.unload_device(file);
+                if (failure) std::rethrow_exception(failure);
+            }
+            catch (const std::exception& e)
+            {
+                r.error = e.what();
+            }
+            r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+            return r;
+        }
+
+        size_t _parallel_files;
+        size_t _read_ahead;
+    };
+}
+
+#endif
@@ -0,0 +1,308 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2017 Intel Corporation. All Rights Reserved.
+
+#ifndef LIBREALSENSE_RS2_BOUNDED_SYNCER_HPP
+#define LIBREALSENSE_RS2_BOUNDED_SYNCER_HPP
+
+#include <map>
+#include <deque>
+#include <mutex>
+#include <cmath>
+#include <chrono>
+#include <thread>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+#include <condition_variable>
+#include "rs_processing.hpp"
+
+namespace rs2
+{
+    /**
+    * Syncer with a bounded latency. Like syncer, it matches frames of different streams by timestamp into framesets,
+    * but no frame waits for its partners longer than the maximum wait: once it expires, the frames matched so far are
+    * released as a partial frameset, so e.g. depth is never stalled by a late color frame. Partial framesets are flagged
+    * by try_wait_for_frames. The matching tolerance, maximum wait and queue depth are options of the block.
+    */
+    class bounded_syncer : public processing_block
+    {
+    public:
+        static const auto OPTION_SYNC_TOLERANCE = rs2_option(RS2_OPTION_COUNT + 50);   // Milliseconds, 0 for half the shortest frame interval
+        static const auto OPTION_SYNC_MAX_WAIT = rs2_option(RS2_OPTION_COUNT + 51);    // Milliseconds a frame may wait for its partners
+        static const auto OPTION_SYNC_QUEUE_DEPTH = rs2_option(RS2_OPTION_COUNT + 52); // Frames waiting per stream
+
+        struct statistics
+        {
+            uint64_t complete;      // Framesets released with a frame of every stream
+            uint64_t partial;       // Framesets released when the maximum wait expired
+            uint64_t dropped;       // Frames discarded by full stream or output queues
+        };
+
+        /**
+        * \param[in] max_wait_ms   Longest time a frame waits for the frames of other streams
+        * \param[in] queue_size    Framesets kept for the consumer
+        */
+        explicit bounded_syncer(float max_wait_ms = 10.f, int queue_size = 1)
+            : bounded_syncer(std::make_shared<impl>(std::max(queue_size, 1)), max_wait_ms)
+        {}
+
+        void operator()(frame f) const { invoke(std::move(f)); }
+
+        /**
+        * Wait for a frameset
+        * \param[out] fs        Matched frameset
+        * \param[out] partial   Set if the frameset is missing streams because the maximum wait expired
+        * \return false if no frameset became available within the timeout
+        */
+        bool try_wait_for_frames(frameset* fs, bool* partial = nullptr, unsigned int timeout_ms = 5000) const
+        {
+            auto& s = *_impl;
+            std::unique_lock<std::mutex> lock(s.results_mutex);
+            if (!s.results_cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), [&] { return !s.results.empty(); }))
+                return false;
+            *fs = frameset(s.results.front().first);
+            if (partial) *partial = s.results.front().second;
+            s.results.pop_front();
+            return true;
+        }
+
+        frameset wait_for_frames(unsigned int timeout_ms = 5000) const
+        {
+            frameset fs;
+            if (!try_wait_for_frames(&fs, nullptr, timeout_ms))
+                throw std::runtime_error("Frame didn't arrive within " + std::to_string(timeout_ms));
+            return fs;
+        }
+
+        bool poll_for_frames(frameset* fs, bool* partial = nullptr) const
+        {
+            return try_wait_for_frames(fs, partial, 0);
+        }
+
+        statistics get_statistics() const
+        {
+            std::lock_guard<std::mutex> lock(_impl->mutex);
+            return _impl->stats;
+        }
+
+    private:
+        typedef std::chrono::steady_clock clock;
+
+        struct pending
+        {
+            frame f;
+            double timestamp;
+            clock::time_point arrival;
+        };
+
+        struct stream
+        {
+            std::deque<pending> frames;
+            int fps = 0;
+        };
+
+        struct impl
+        {
+            explicit impl(int queue_size) : output_size(size_t(queue_size)) {}
+
+            // Set while the ticker re-invokes the block to release expired frames
+            static bool& ticking()
+            {
+                static thread_local bool t = false;
+                return t;
+            }
+
+            float option(rs2_option id) const
+            {
+                rs2_error* e = nullptr;
+                float value = rs2_get_option(options, id, &e);
+                error::handle(e);
+                return value;
+            }
+
+            void process(frame f, frame_source& source)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                const auto now = clock::now();
+                const size_t depth = size_t(std::max(1.f, option(OPTION_SYNC_QUEUE_DEPTH)));
+                if (!ticking())
+                {
+                    auto add = [&](const frame& sub) {
+                        auto profile = sub.get_profile();
+                        auto& s = streams[profile.unique_id()];
+                        s.fps = profile.fps();
+                        s.frames.push_back({ sub, sub.get_timestamp(), now });
+                        if (s.frames.size() > depth)
+                        {
+                            s.frames.pop_front();
+                            ++stats.dropped;
+                        }
+                    };
+                    if (auto fs = f.as<frameset>())
+                        for (const frame& sub : fs) add(sub);
+                    else
+                        add(f);
+                }
+                release(now, source);
+            }
+
+            double tolerance() const
+            {
+                const double configured = option(OPTION_SYNC_TOLERANCE);
+                if (configured > 0) return configured;
+                int fps = 0;
+                for (auto& s : streams) fps = std::max(fps, s.second.fps);
+                return fps ? 500. / fps : 16.;
+            }
+
+            // Release every frameset that is complete or whose oldest frame waited long enough
+            void release(clock::time_point now, frame_source& source)
+            {
+                const auto max_wait = std::chrono::microseconds(int64_t(option(OPTION_SYNC_MAX_WAIT) * 1000));
+                const double tol = tolerance();
+                has_deadline = false;
+                for (;;)
+                {
+                    // The oldest waiting frame anchors the next frameset
+                    const pending* anchor = nullptr;
+                    for (auto& s : streams)
+                        if (!s.second.frames.empty() && (!anchor || s.second.frames.front().timestamp < anchor->timestamp))
+                            anchor = &s.second.frames.front();
+                    if (!anchor) return;
+
+                    std::vector<std::pair<std::deque<pending>*, size_t>> picks;
+                    bool complete = true;
+                    for (auto& s : streams)
+                    {
+                        auto& q = s.second.frames;
+                        size_t best = q.size();
+                        for (size_t i = 0; i < q.size(); ++i)
+                            if (std::fabs(q[i].timestamp - anchor->timestamp) <= tol
+                                && (best == q.size() || std::fabs(q[i].timestamp - anchor->timestamp) < std::fabs(q[best].timestamp - anchor->timestamp)))
+                                best = i;
+                        if (best < q.size()) picks.push_back({ &q, best });
+                        else complete = false;
+                    }
+
+                    if (!complete && now - anchor->arrival < max_wait)
+                    {
+                        // Come back when the anchor expires
+                        has_deadline = true;
+                        deadline = anchor->arrival + max_wait;
+                        anchor_frame = anchor->f;
+                        cv.notify_all();
+                        return;
+                    }
+
+                    std::vector<frame> set;
+                    for (auto& p : picks)
+                    {
+                        set.push_back(p.first->at(p.second).f);
+                        stats.dropped += p.second;
+                        p.first->erase(p.first->begin(), p.first->begin() + p.second + 1);
+                    }
+                    ++(complete ? stats.complete : stats.partial);
+                    releasing_partial = !complete;
+                    source.frame_ready(source.allocate_composite_frame(set));
+                }
+            }
+
+            // Output of the block, called synchronously from frame_ready
+            void deliver(frame f)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(results_mutex);
+                    results.push_back({ f, releasing_partial });
+                    if (results.size() > output_size)
+                    {
+                        results.pop_front();
+                        ++stats.dropped;
+                    }
+                }
+                results_cv.notify_one();
+            }
+
+            // Matching state, guarded by mutex
+            std::mutex mutex;
+            std::condition_variable cv;
+            std::map<int, stream> streams;
+            rs2_options* options = nullptr;
+            statistics stats = { 0, 0, 0 };
+            bool releasing_partial = false;
+            bool has_deadline = false;
+            bool stopping = false;
+            clock::time_point deadline;
+            frame anchor_frame;
+
+            // Output, guarded by results_mutex
+            std::mutex results_mutex;
+            std::condition_variable results_cv;
+            std::deque<std::pair<frame, bool>> results;
+            size_t output_size;
+        };
+
+        // Releases partial framesets when no new frame arrives to trigger it, by re-invoking the block with the expired frame
+        class ticker
+        {
+        public:
+            ticker(std::shared_ptr<impl> state, processing_block block)
+                : _impl(state), _thread([this, block]() { run(block); })
+            {}
+
+            ~ticker()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(_impl->mutex);
+                    _impl->stopping = true;
+                }
+                _impl->cv.notify_all();
+                _thread.join();
+            }
+
+        private:
+            void run(processing_block block)
+            {
+                auto& s = *_impl;
+                std::unique_lock<std::mutex> lock(s.mutex);
+                while (!s.stopping)
+                {
+                    if (!s.has_deadline) s.cv.wait(lock);
+                    else if (clock::now() < s.deadline) s.cv.wait_until(lock, s.deadline);
+                    else
+                    {
+                        frame anchor = s.anchor_frame;
+                        s.has_deadline = false;
+                        lock.unlock();
+                        impl::ticking() = true;
+                        try { block.invoke(anchor); }
+                        catch (...) {}
+                        impl::ticking() = false;
+                        lock.lock();
+                    }
+                }
+            }
+
+            std::shared_ptr<impl> _impl;
+            std::thread _thread;
+        };
+
+        bounded_syncer(std::shared_ptr<impl> state, float max_wait_ms)
+            : processing_block([state](frame f, frame_source& s) { state->process(f, s); }), _impl(state)
+        {
+            register_simple_option(OPTION_SYNC_TOLERANCE, option_range{ 0, 100, 0, 0.1f });
+            register_simple_option(OPTION_SYNC_MAX_WAIT, option_range{ 0, 1000, max_wait_ms, 0.5f });
+            register_simple_option(OPTION_SYNC_QUEUE_DEPTH, option_range{ 1, 32, 4, 1 });
+            _impl->options = *this;
+            start([state](frame f) { state->deliver(f); });
+            _ticker = std::make_shared<ticker>(state, processing_block(_block));
+        }
+
+        std::shared_ptr<impl> _impl;
+        std::shared_ptr<ticker> _ticker;
+    };
+}
+
+#endif
@@ -0,0 +1,226 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2017 Intel Corporation. All Rights Reserved.
+
+#ifndef LIBREALSENSE_RS2_CAPTURE_RING_HPP
+#define LIBREALSENSE_RS2_CAPTURE_RING_HPP
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+#include "../rs.hpp"
+#include "rs_metadata_log.hpp"
+#include "rs_platform.hpp"
+
+namespace rs2
+{
+    /**
+    * Ring of fixed-size frame slots in a preallocated, memory-mapped file. Capturing a frame copies its pixels and
+    * metadata into the next slot and nothing else: no encoding, no allocation and no system call, the operating system
+    * writes the pages back to disk in the background. Once the ring is full the oldest frames are overwritten, so the
+    * file always holds the most recent frames, e.g. the seconds leading up to an event. Slots are converted to images
+    * offline, by opening the file again for reading.
+    * Slots are claimed with an atomic counter, so the ring can be started on several sensors at once. The copy kept by
+    * the pipeline or sensor captures into the same mapping as the application's, whose get_statistics counts its frames.
+    */
+    class capture_ring
+    {
+    public:
+        static const int MAX_METADATA = 128;
+
+        // Start of every slot, followed by the pixels
+        struct slot_header
+        {
+            uint64_t sequence;          // Capture order starting at 1, 0 for a slot never written or being written
+            int32_t stream;
+            int32_t index;
+            int32_t format;
+            int32_t width;
+            int32_t height;
+            int32_t stride;
+            int32_t bpp;
+            int32_t domain;
+            uint64_t frame_number;
+            double timestamp;
+            float depth_units;
+            uint32_t size;              // Bytes of pixels following the header
+            uint64_t metadata_supported[MAX_METADATA / 64];
+            int64_t metadata[MAX_METADATA];
+
+            bool supports(rs2_frame_metadata_value m) const { return (metadata_supported[m / 64] >> (m % 64)) & 1; }
+        };
+
+        struct statistics
+        {
+            uint64_t written;           // Frames captured
+            uint64_t dropped;           // Frames larger than a slot
+        };
+
+        /**
+        * Create the ring file, replacing an existing one. Its disk space is allocated and its pages faulted in here, so a
+        * disk too small for the ring fails now with an exception rather than during the capture.
+        * \param[in] path        File to create
+        * \param[in] slot_count  Frames the ring holds
+        * \param[in] slot_size   Largest frame in bytes, e.g. stride times height of the largest stream
+        */
+        capture_ring(const std::string& path, size_t slot_count, size_t slot_size)
+            : _impl(std::make_shared<impl>())
+        {
+            static_assert(RS2_FRAME_METADATA_COUNT <= MAX_METADATA, "capture_ring::MAX_METADATA is too small");
+            auto& s = *_impl;
+            s.slot_stride = round_up(HEADER_SIZE + slot_size, PAGE_BYTES);
+            const uint64_t size = PAGE_BYTES + uint64_t(s.slot_stride) * std::max<size_t>(slot_count, 1);
+            s.map(path, size, true);
+
+            auto file = s.file_header();
+            file->magic = MAGIC;
+            file->slot_count = uint32_t(std::max<size_t>(slot_count, 1));
+            file->slot_stride = s.slot_stride;
+            for (size_t i = 0; i < file->slot_count; ++i) s.slot(i)->sequence = 0;
+        }
+
+        /**
+        * Open a ring file written earlier, for reading
+        */
+        static capture_ring open(const std::string& path)
+        {
+            capture_ring ring;
+            auto& s = *ring._impl;
+            s.map(path, 0, false);
+            auto file = s.file_header();
+            if (s.size < PAGE_BYTES || file->magic != MAGIC || PAGE_BYTES + uint64_t(file->slot_stride) * file->slot_count > s.size)
+                throw std::runtime_error(path + " is not a capture ring");
+            s.slot_stride = size_t(file->slot_stride);
+            return ring;
+        }
+
+        /**
+        * Capture a frame, or every frame of a frameset
+        */
+        void operator()(frame f) const
+        {
+            if (auto fs = f.as<frameset>())
+            {
+                for (const frame& sub : fs) (*this)(sub);
+                return;
+            }
+            auto& s = *_impl;
+            const size_t size = size_t(f.get_data_size());
+            if (HEADER_SIZE + size > s.slot_stride)
+            {
+                ++s.dropped;
+                return;
+            }
+
+            const uint64_t sequence = ++s.file_header()->next;
+            auto h = s.slot(size_t((sequence - 1) % s.file_header()->slot_count));
+            reinterpret_cast<std::atomic<uint64_t>*>(&h->sequence)->store(0, std::memory_order_relaxed);
+
+            auto profile = f.get_profile();
+            h->stream = int32_t(profile.stream_type());
+            h->index = profile.stream_index();
+            h->format = int32_t(profile.format());
+            h->width = h->height = h->stride = h->bpp = 0;
+            h->depth_units = 0;
+            if (auto vf = f.as<video_frame>())
+            {
+                h->width = vf.get_width();
+                h->height = vf.get_height();
+                h->stride = vf.get_stride_in_bytes();
+                h->bpp = vf.get_bytes_per_pixel();
+                if (auto depth = vf.as<depth_frame>()) h->depth_units = depth.get_units();
+            }
+            h->domain = int32_t(f.get_frame_timestamp_domain());
+            h->frame_number = f.get_frame_number();
+            h->timestamp = f.get_timestamp();
+            h->size = uint32_t(size);
+
+            std::fill(std::begin(h->metadata_supported), std::end(h->metadata_supported), 0);
+            for (auto m : s.attributes.of(f))
+            {
+                rs2_error* e = nullptr;
+                h->metadata[m] = rs2_get_frame_metadata(f.get(), m, &e);
+                if (e) rs2_free_error(e);
+                else h->metadata_supported[m / 64] |= uint64_t(1) << (m % 64);
+            }
+            memcpy(reinterpret_cast<char*>(h) + HEADER_SIZE, f.get_data(), size);
+
+            // Publish the slot only once it is complete, so a reader never takes a half-written frame for a whole one
+            reinterpret_cast<std::atomic<uint64_t>*>(&h->sequence)->store(sequence, std::memory_order_release);
+            ++s.written;
+        }
+
+        size_t slot_count() const { return _impl->file_header()->slot_count; }
+
+        const slot_header& header(size_t slot) const { return *_impl->slot(slot); }
+
+        const void* data(size_t slot) const { return reinterpret_cast<const char*>(_impl->slot(slot)) + HEADER_SIZE; }
+
+        /**
+        * Slots holding a complete frame, oldest first
+        */
+        std::vector<size_t> captured() const
+        {
+            std::vector<size_t> slots;
+            for (size_t i = 0; i < slot_count(); ++i)
+                if (header(i).sequence) slots.push_back(i);
+            std::sort(slots.begin(), slots.end(), [this](size_t a, size_t b) { return header(a).sequence < header(b).sequence; });
+            return slots;
+        }
+
+        statistics get_statistics() const { return{ _impl->written.load(), _impl->dropped.load() }; }
+
+    private:
+        static const uint64_t MAGIC = 0x31474E4952535231ull;   // "1RSRING1"
+        static const size_t PAGE_BYTES = 4096;
+        static const size_t HEADER_SIZE = (sizeof(slot_header) + 63) / 64 * 64;
+
+        // First page of the file
+        struct ring_header
+        {
+            uint64_t magic;
+            uint32_t slot_count;
+            uint32_t reserved;
+            uint64_t slot_stride;
+            std::atomic<uint64_t> next;     // Frames captured so far
+        };
+
+        struct impl
+        {
+            // Map the whole file, creating it with the given size if writable
+            void map(const std::string& path, uint64_t create_size, bool writable)
+            {
+                file.map(path, create_size, writable);
+                view = file.data();
+                size = file.size();
+            }
+
+            ring_header* file_header() const { return static_cast<ring_header*>(view); }
+
+            slot_header* slot(size_t i) const
+            {
+                return reinterpret_cast<slot_header*>(static_cast<char*>(view) + PAGE_BYTES + i * slot_stride);
+            }
+
+            platform::mapped_file file;
+            void* view = nullptr;
+            uint64_t size = 0;
+            size_t slot_stride = 0;
+            std::atomic<uint64_t> written{ 0 };
+            std::atomic<uint64_t> dropped{ 0 };
+            metadata_attributes attributes;     // Looked up once per stream profile
+        };
+
+        capture_ring() : _impl(std::make_shared<impl>()) {}
+
+        static size_t round_up(size_t value, size_t multiple) { return (value + multiple - 1) / multiple * multiple; }
+
+        std::shared_ptr<impl> _impl;
+    };
+}
+
+#endif
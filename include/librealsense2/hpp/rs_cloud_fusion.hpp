@@ -0,0 +1,244 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2017 Intel Corporation. All Rights Reserved.
+
+#ifndef LIBREALSENSE_RS2_CLOUD_FUSION_HPP
+#define LIBREALSENSE_RS2_CLOUD_FUSION_HPP
+
+#include <map>
+#include <mutex>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <unordered_map>
+#include "rs_frame.hpp"
+#include "rs_sensor.hpp"
+#include "rs_executor.hpp"
+#include "../rsutil.h"
+
+namespace rs2
+{
+    /**
+    * Fuses the depth of many cameras into a single point cloud in a shared world frame.
+    * Every camera is placed in the world by a camera-to-world extrinsic, registered by serial number. Depth frames are
+    * deprojected and transformed in bands of rows, which run in parallel on an executor, so the cost of fusion is spread
+    * over the cores rather than over the cameras. Points are then merged into a voxel grid: every occupied voxel yields a
+    * single point, the centroid of the points that fell into it, so surfaces seen by several cameras appear only once.
+    */
+    class point_cloud_fusion
+    {
+    public:
+        /**
+        * \param[in] voxel_size  Edge of a voxel in meters, zero to keep every point
+        * \param[in] ex          Executor running the work, the process-wide executor by default
+        * \param[in] p           Priority of the work on the executor
+        */
+        explicit point_cloud_fusion(float voxel_size = 0.005f, executor& ex = executor::instance(),
+            executor::priority p = executor::priority::normal)
+            : _voxel_size(voxel_size), _executor(ex), _priority(p)
+        {}
+
+        /**
+        * Place the camera with the given serial number in the world. Cameras without an extrinsic stay at the world origin.
+        * \param[in] camera_to_world  Transformation from the coordinates of the depth stream of the camera to world coordinates
+        */
+        void set_extrinsics(const std::string& serial, const rs2_extrinsics& camera_to_world)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _extrinsics[serial] = camera_to_world;
+        }
+
+        void set_voxel_size(float meters)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _voxel_size = std::max(meters, 0.f);
+        }
+
+        /**
+        * Fuse depth frames of different cameras, e.g. a bundle of frame_multiplexer
+        * \param[in] frames  Depth frames or framesets containing them; other frames are ignored
+        * \return World-frame points, valid until the next call
+        */
+        const std::vector<vertex>& fuse(const std::vector<frame>& frames)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            // Split the work into bands of rows of all cameras
+            _jobs.clear();
+            for (auto&& f : frames)
+            {
+                auto fs = f.as<frameset>();
+                depth_frame depth = fs ? fs.get_depth_frame() : f.as<depth_frame>();
+                if (!depth) continue;
+                auto& cam = camera_of(depth);
+                for (int y = 0; y < depth.get_height(); y += BAND_ROWS)
+                    _jobs.push_back({ depth, &cam, y, std::min(y + BAND_ROWS, depth.get_height()) });
+            }
+
+            const size_t shards = _voxel_size > 0 ? _executor.threads() : 1;
+            _bands.resize(_jobs.size());
+            for (auto& band : _bands)
+            {
+                band.resize(shards);
+                for (auto& bucket : band) bucket.clear();
+            }
+
+            _executor.parallel_for(_jobs.size(), [this, shards](size_t i) { deproject(_jobs[i], _bands[i], shards); }, _priority);
+
+            _points.clear();
+            if (_voxel_size <= 0)
+            {
+                for (auto& band : _bands)
+                    for (auto& p : band[0]) _points.push_back(p.point);
+                return _points;
+            }
+
+            // Every voxel falls in a single shard, so shards are merged independently
+            _shards.resize(shards);
+            _voxels.resize(shards);
+            _accumulators.resize(shards);
+            _executor.parallel_for(shards, [this](size_t s) { merge(s); }, _priority);
+            for (auto& shard : _shards)
+                _points.insert(_points.end(), shard.begin(), shard.end());
+            return _points;
+        }
+
+        const std::vector<vertex>& get_points() const { return _points; }
+
+    private:
+        static const int BAND_ROWS = 32;
+
+        struct camera
+        {
+            std::string serial;
+            int width = 0;
+            int height = 0;
+            std::vector<float> rays;    // Point at depth 1 of every pixel, as x, y pairs
+        };
+
+        struct job
+        {
+            depth_frame depth;
+            const camera* cam;
+            int first_row;
+            int last_row;
+        };
+
+        struct entry
+        {
+            uint64_t key;
+            vertex point;
+        };
+
+        struct accumulator
+        {
+            double x, y, z;
+            int count;
+        };
+
+        // Ray table of the depth stream, computed once per stream profile
+        camera& camera_of(const depth_frame& depth)
+        {
+            auto& cam = _cameras[depth.get_profile().unique_id()];
+            if (cam.width != depth.get_width() || cam.height != depth.get_height())
+            {
+                auto intrin = depth.get_profile().as<video_stream_profile>().get_intrinsics();
+                auto s = sensor_from_frame(depth);
+                cam.serial = s->supports(RS2_CAMERA_INFO_SERIAL_NUMBER) ? s->get_info(RS2_CAMERA_INFO_SERIAL_NUMBER) : "";
+                cam.width = intrin.width;
+                cam.height = intrin.height;
+                cam.rays.resize(size_t(intrin.width) * intrin.height * 2);
+                for (int y = 0; y < intrin.height; ++y)
+                    for (int x = 0; x < intrin.width; ++x)
+                    {
+                        const float pixel[2] = { float(x), float(y) };
+                        float point[3];
+                        rs2_deproject_pixel_to_point(point, &intrin, pixel, 1.f);
+                        cam.rays[(size_t(y) * intrin.width + x) * 2] = point[0];
+                        cam.rays[(size_t(y) * intrin.width + x) * 2 + 1] = point[1];
+                    }
+            }
+            return cam;
+        }
+
+        static uint64_t voxel_key(const vertex& p, float inv_size)
+        {
+            // 21 bits per axis, centered on the world origin
+            auto axis = [inv_size](float v) { return uint64_t(int64_t(std::floor(v * inv_size)) + (1 << 20)) & 0x1FFFFF; };
+            return (axis(p.x) << 42) | (axis(p.y) << 21) | axis(p.z);
+        }
+
+        void deproject(const job& j, std::vector<std::vector<entry>>& buckets, size_t shards) const
+        {
+            static const rs2_extrinsics identity = { { 1, 0, 0, 0, 1, 0, 0, 0, 1 }, { 0, 0, 0 } };
+            auto it = _extrinsics.find(j.cam->serial);
+            const rs2_extrinsics& e = it != _extrinsics.end() ? it->second : identity;
+            const float* r = e.rotation;
+            const float* t = e.translation;
+
+            const int w = j.depth.get_width();
+            const float units = j.depth.get_units();
+            const float inv_size = _voxel_size > 0 ? 1.f / _voxel_size : 0.f;
+            const uint16_t* data = reinterpret_cast<const uint16_t*>(j.depth.get_data());
+            for (int y = j.first_row; y < j.last_row; ++y)
+            {
+                const uint16_t* row = data + size_t(y) * w;
+                const float* rays = j.cam->rays.data() + size_t(y) * w * 2;
+                for (int x = 0; x < w; ++x)
+                {
+                    if (!row[x]) continue;
+                    const float z = row[x] * units;
+                    const float px = rays[x * 2] * z, py = rays[x * 2 + 1] * z;
+                    // Rotation is stored column-major
+                    vertex p = { r[0] * px + r[3] * py + r[6] * z + t[0],
+                                 r[1] * px + r[4] * py + r[7] * z + t[1],
+                                 r[2] * px + r[5] * py + r[8] * z + t[2] };
+                    const uint64_t key = inv_size ? voxel_key(p, inv_size) : 0;
+                    buckets[shards > 1 ? (key * 0x9E3779B97F4A7C15ull >> 32) % shards : 0].push_back({ key, p });
+                }
+            }
+        }
+
+        void merge(size_t shard)
+        {
+            auto& index = _voxels[shard];
+            auto& acc = _accumulators[shard];
+            index.clear();
+            acc.clear();
+            for (auto& band : _bands)
+                for (auto& e : band[shard])
+                {
+                    auto res = index.emplace(e.key, acc.size());
+                    if (res.second) acc.push_back({ 0, 0, 0, 0 });
+                    auto& a = acc[res.first->second];
+                    a.x += e.point.x;
+                    a.y += e.point.y;
+                    a.z += e.point.z;
+                    ++a.count;
+                }
+
+            auto& out = _shards[shard];
+            out.resize(acc.size());
+            for (size_t i = 0; i < acc.size(); ++i)
+                out[i] = { float(acc[i].x / acc[i].count), float(acc[i].y / acc[i].count), float(acc[i].z / acc[i].count) };
+        }
+
+        std::mutex _mutex;
+        float _voxel_size;
+        executor& _executor;
+        executor::priority _priority;
+        std::map<std::string, rs2_extrinsics> _extrinsics;
+        std::map<int, camera> _cameras;
+
+        // Scratch buffers reused from call to call
+        std::vector<job> _jobs;
+        std::vector<std::vector<std::vector<entry>>> _bands;    // Band, shard
+        std::vector<std::unordered_map<uint64_t, size_t>> _voxels;      // Voxel to accumulator, per shard
+        std::vector<std::vector<accumulator>> _accumulators;
+        std::vector<std::vector<vertex>> _shards;
+        std::vector<vertex> _points;
+    };
+}
+
+#endif
@@ -0,0 +1,330 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2017 Intel Corporation. All Rights Reserved.
+
+#ifndef LIBREALSENSE_RS2_COROUTINE_HPP
+#define LIBREALSENSE_RS2_COROUTINE_HPP
+
+// Requires C++20 coroutines; the header is empty for older standards
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+
+#include <deque>
+#include <queue>
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <exception>
+#include <coroutine>
+#include <functional>
+#include <condition_variable>
+#include "../rs.hpp"
+
+namespace rs2
+{
+    /**
+    * Awaitable frame acquisition for C++20 coroutines. A single thread runs an event_loop, which resumes coroutines when
+    * frames, processing results or timers they wait for are ready, so one thread can serve several cameras together with
+    * other I/O without blocking. Frames are delivered by the callback mode of the SDK (pipeline::start(callback),
+    * processing_block::start(callback)); the SDK threads only post them to the loop.
+    *
+    *   rs2::co::event_loop loop;
+    *   rs2::co::async_pipeline pipe(loop);
+    *   pipe.start();
+    *   auto camera = [&]() -> rs2::co::task {
+    *       for (;;) {
+    *           rs2::frameset fs = co_await pipe.next_frameset();
+    *           ...
+    *       }
+    *   };
+    *   camera();
+    *   loop.run();
+    */
+    namespace co
+    {
+        /**
+        * Single-threaded event loop. post and stop may be called from any thread; everything else,
+        * including awaiting, must happen on the thread running the loop.
+        * Frame channels refer to the loop weakly, so SDK threads delivering frames after the loop is destroyed drop them.
+        */
+        class event_loop
+        {
+        public:
+            typedef std::chrono::steady_clock clock;
+
+            event_loop() : _core(std::make_shared<core>()) {}
+
+            event_loop(const event_loop&) = delete;
+            event_loop& operator=(const event_loop&) = delete;
+
+            /**
+            * Run a function on the loop thread. Functions posted while the loop is not running wait for the next run
+            */
+            void post(std::function<void()> work) { _core->post(std::move(work)); }
+
+            /**
+            * Run until stop is called
+            */
+            void run()
+            {
+                auto& c = *_core;
+                std::vector<std::function<void()>> work;
+                std::unique_lock<std::mutex> lock(c.mutex);
+                c.stopped = false;
+                while (!c.stopped)
+                {
+                    if (c.posted.empty())
+                    {
+                        if (c.timers.empty()) c.cv.wait(lock);
+                        else c.cv.wait_until(lock, c.timers.top().first);
+                    }
+
+                    work.assign(std::make_move_iterator(c.posted.begin()), std::make_move_iterator(c.posted.end()));
+                    c.posted.clear();
+                    std::vector<std::coroutine_handle<>> expired;
+                    while (!c.timers.empty() && c.timers.top().first <= clock::now())
+                    {
+                        expired.push_back(c.timers.top().second);
+                        c.timers.pop();
+                    }
+
+                    lock.unlock();
+                    for (auto& w : work) w();
+                    for (auto h : expired) h.resume();
+                    work.clear();
+                    lock.lock();
+                }
+            }
+
+            void stop()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(_core->mutex);
+                    _core->stopped = true;
+                }
+                _core->cv.notify_one();
+            }
+
+            /**
+            * co_await loop.sleep_for(std::chrono::milliseconds(10)) resumes the coroutine on the loop after the delay
+            */
+            auto sleep_for(clock::duration delay)
+            {
+                struct awaiter
+                {
+                    event_loop& loop;
+                    clock::time_point when;
+                    bool await_ready() const { return false; }
+                    void await_suspend(std::coroutine_handle<> h)
+                    {
+                        std::lock_guard<std::mutex> lock(loop._core->mutex);
+                        loop._core->timers.push({ when, h });
+                    }
+                    void await_resume() const {}
+                };
+                return awaiter{ *this, clock::now() + delay };
+            }
+
+        private:
+            friend class frame_channel;
+
+            typedef std::pair<clock::time_point, std::coroutine_handle<>> timer;
+            struct later
+            {
+                bool operator()(const timer& a, const timer& b) const { return a.first > b.first; }
+            };
+
+            // Shared with the frame channels of the loop, which hold it weakly
+            struct core
+            {
+                void post(std::function<void()> work)
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        posted.push_back(std::move(work));
+                    }
+                    cv.notify_one();
+                }
+
+                std::mutex mutex;
+                std::condition_variable cv;
+                std::deque<std::function<void()>> posted;
+                std::priority_queue<timer, std::vector<timer>, later> timers;
+                bool stopped = false;
+            };
+
+            std::shared_ptr<core> _core;
+        };
+
+        /**
+        * Coroutine started immediately and running on its own, suspending whenever it awaits.
+        * An exception escaping the coroutine is reported through the SDK log.
+        */
+        struct task
+        {
+            struct promise_type
+            {
+                task get_return_object() { return {}; }
+                std::suspend_never initial_suspend() noexcept { return {}; }
+                std::suspend_never final_suspend() noexcept { return {}; }
+                void return_void() {}
+                void unhandled_exception()
+                {
+                    try { throw; }
+                    catch (const std::exception& e) { log(RS2_LOG_SEVERITY_ERROR, e.what()); }
+                    catch (...) { log(RS2_LOG_SEVERITY_ERROR, "Unknown exception in coroutine"); }
+                }
+            };
+        };
+
+        /**
+        * Frame queue awaited by coroutines: co_await channel.next(). The channel is a frame callback, so it can be
+        * passed to pipeline::start or processing_block::start; frames pushed from other threads wake the loop.
+        * Holds up to capacity frames, dropping the oldest when a coroutine does not keep up. Frames are queued in the
+        * channel rather than posted one by one, so a loop that is not running holds at most capacity frames per channel.
+        * Copies share the same channel. Only one coroutine may await a channel at a time.
+        */
+        class frame_channel
+        {
+        public:
+            explicit frame_channel(event_loop& loop, size_t capacity = 1)
+                : _state(std::make_shared<state>(loop._core, std::max<size_t>(capacity, 1)))
+            {}
+
+            void operator()(frame f) const
+            {
+                auto s = _state;
+                {
+                    std::lock_guard<std::mutex> lock(s->mutex);
+                    s->frames.push_back(std::move(f));
+                    if (s->frames.size() > s->capacity)
+                    {
+                        s->frames.pop_front();
+                        ++s->dropped;
+                    }
+                    // One wake-up in flight is enough for any number of frames
+                    if (s->wake_posted) return;
+                    s->wake_posted = true;
+                }
+                if (auto loop = s->loop.lock())
+                    loop->post([s]() { s->wake(); });
+            }
+
+            /**
+            * Awaitable resolving to the next frame
+            */
+            auto next() const
+            {
+                struct awaiter
+                {
+                    std::shared_ptr<state> s;
+                    bool await_ready() const
+                    {
+                        std::lock_guard<std::mutex> lock(s->mutex);
+                        return !s->frames.empty();
+                    }
+                    void await_suspend(std::coroutine_handle<> h) { s->waiter = h; }
+                    frame await_resume()
+                    {
+                        std::lock_guard<std::mutex> lock(s->mutex);
+                        frame f = std::move(s->frames.front());
+                        s->frames.pop_front();
+                        return f;
+                    }
+                };
+                return awaiter{ _state };
+            }
+
+            size_t dropped() const
+            {
+                std::lock_guard<std::mutex> lock(_state->mutex);
+                return _state->dropped;
+            }
+
+        private:
+            struct state
+            {
+                state(std::weak_ptr<event_loop::core> l, size_t c) : loop(std::move(l)), capacity(c) {}
+
+                // Runs on the loop thread
+                void wake()
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        wake_posted = false;
+                        if (frames.empty()) return;
+                    }
+                    if (auto h = std::exchange(waiter, nullptr))
+                        h.resume();
+                }
+
+                std::weak_ptr<event_loop::core> loop;
+                size_t capacity;
+                std::mutex mutex;
+                std::deque<frame> frames;
+                bool wake_posted = false;
+                size_t dropped = 0;
+                std::coroutine_handle<> waiter;     // Only touched on the loop thread
+            };
+
+            std::shared_ptr<state> _state;
+        };
+
+        /**
+        * Pipeline whose frames are awaited instead of waited for. Synchronized streams arrive through next_frameset,
+        * streams that bypass synchronization (such as IMU) through next_frame.
+        */
+        class async_pipeline
+        {
+        public:
+            explicit async_pipeline(event_loop& loop, context ctx = context(), size_t capacity = 1)
+                : _pipe(ctx), _framesets(loop, capacity), _frames(loop, capacity)
+            {}
+
+            pipeline_profile start(const config& cfg = config())
+            {
+                auto framesets = _framesets;
+                auto frames = _frames;
+                return _pipe.start(cfg, [framesets, frames](frame f) {
+                    if (f.is<frameset>()) framesets(f);
+                    else frames(f);
+                });
+            }
+
+            void stop() { _pipe.stop(); }
+
+            /**
+            * co_await pipe.next_frameset()
+            */
+            auto next_frameset() const
+            {
+                struct awaiter
+                {
+                    decltype(std::declval<frame_channel>().next()) inner;
+                    bool await_ready() const { return inner.await_ready(); }
+                    void await_suspend(std::coroutine_handle<> h) { inner.await_suspend(h); }
+                    frameset await_resume() { return frameset(inner.await_resume()); }
+                };
+                return awaiter{ _framesets.next() };
+            }
+
+            /**
+            * co_await pipe.next_frame(), for frames outside of framesets
+            */
+            auto next_frame() const { return _frames.next(); }
+
+            pipeline& get() { return _pipe; }
+
+        private:
+            pipeline _pipe;
+            frame_channel _framesets;
+            frame_channel _frames;
+        };
+    }
+}
+
+#endif
+#endif
+
+#endif
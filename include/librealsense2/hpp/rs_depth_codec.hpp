@@ -0,0 +1,642 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2017 Intel Corporation. All Rights Reserved.
+
+#ifndef LIBREALSENSE_RS2_DEPTH_CODEC_HPP
+#define LIBREALSENSE_RS2_DEPTH_CODEC_HPP
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include "rs_frame.hpp"
+#include "rs_processing.hpp"
+#include "rs_executor.hpp"
+#include "rs_fused_filter.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RS2_DEPTH_CODEC_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define RS2_DEPTH_CODEC_NEON
+#endif
+
+namespace rs2
+{
+    /**
+    * Lossless codec for Z16 depth images. Every pixel is predicted from its left, upper and upper-left neighbours
+    * (the median edge detector of LOCO-I), which follows the smooth surfaces of depth images closely, so most prediction
+    * residuals are small and runs of zeros are common, e.g. in holes. The residuals are coded with a canonical Huffman code
+    * built for each band of rows, with dedicated symbols for runs of zero residuals.
+    * Bands are independent of each other, so they are encoded and decoded in parallel on an executor, and prediction is
+    * vectorized with SSE2 or NEON where available. Images that would not get smaller are stored uncompressed.
+    * Encoding and decoding are thread safe.
+    */
+    class depth_codec
+    {
+    public:
+        /**
+        * \param[in] band_rows  Rows per band, the unit of parallel work
+        * \param[in] ex         Executor coding the bands
+        * \param[in] p          Priority of the coding relative to other work on the executor
+        */
+        explicit depth_codec(int band_rows = 32, executor& ex = executor::instance(), executor::priority p = executor::priority::normal)
+            : _band_rows(std::max(band_rows, 1)), _executor(ex), _priority(p)
+        {}
+
+        /**
+        * Largest encoded size of an image
+        */
+        size_t max_encoded_size(int width, int height) const
+        {
+            return sizeof(header) + size_t(width) * height * 2;
+        }
+
+        /**
+        * Encode a Z16 image
+        * \param[in] depth   First row of the image
+        * \param[in] stride  Bytes from one row to the next
+        * \param[out] out    Encoded image, resized to fit
+        * \return Size of the encoded image
+        */
+        size_t encode(const uint16_t* depth, int width, int height, int stride, std::vector<uint8_t>& out) const
+        {
+            const int bands = (height + _band_rows - 1) / _band_rows;
+            std::vector<std::vector<uint8_t>> payloads(static_cast<size_t>(bands));
+            _executor.parallel_for(size_t(bands), [&](size_t b) {
+                const int first = int(b) * _band_rows;
+                encode_band(depth, width, first, std::min(height, first + _band_rows), stride, payloads[b]);
+            }, _priority);
+
+            size_t total = sizeof(header) + sizeof(uint32_t) * size_t(bands);
+            for (auto& p : payloads) total += p.size();
+            const size_t raw = size_t(width) * height * 2;
+
+            header h = { MAGIC, uint32_t(width), uint32_t(height), uint32_t(_band_rows), uint32_t(bands), 0 };
+            if (total >= sizeof(header) + raw)
+            {
+                h.bands = 0;
+                h.flags = RAW;
+                out.resize(sizeof(header) + raw);
+                memcpy(out.data(), &h, sizeof(h));
+                for (int y = 0; y < height; ++y)
+                    memcpy(out.data() + sizeof(h) + size_t(y) * width * 2, reinterpret_cast<const uint8_t*>(depth) + size_t(y) * stride, size_t(width) * 2);
+                return out.size();
+            }
+
+            out.resize(total);
+            uint8_t* p = out.data();
+            memcpy(p, &h, sizeof(h));
+            p += sizeof(h);
+            for (auto& payload : payloads)
+            {
+                const uint32_t size = uint32_t(payload.size());
+                memcpy(p, &size, sizeof(size));
+                p += sizeof(size);
+            }
+            for (auto& payload : payloads)
+            {
+                memcpy(p, payload.data(), payload.size());
+                p += payload.size();
+            }
+            return total;
+        }
+
+        /**
+        * Read the dimensions and encoded size of an image
+        * \return false if the data is not an encoded image
+        */
+        static bool info(const uint8_t* data, size_t size, int& width, int& height, size_t& encoded_size)
+        {
+            header h;
+            if (size < sizeof(h)) return false;
+            memcpy(&h, data, sizeof(h));
+            if (h.magic != MAGIC) return false;
+            width = int(h.width);
+            height = int(h.height);
+            encoded_size = sizeof(h);
+            if (h.flags & RAW) encoded_size += size_t(h.width) * h.height * 2;
+            else
+            {
+                encoded_size += sizeof(uint32_t) * size_t(h.bands);
+                if (size < encoded_size) return false;
+                for (uint32_t b = 0; b < h.bands; ++b)
+                {
+                    uint32_t band_size;
+                    memcpy(&band_size, data + sizeof(h) + sizeof(uint32_t) * b, sizeof(band_size));
+                    encoded_size += band_size;
+                }
+            }
+            return encoded_size <= size;
+        }
+
+        /**
+        * Decode an image
+        * \param[out] depth   First row of the output image, of the encoded width and height
+        * \param[in] stride   Bytes from one output row to the next
+        * \return false if the data is corrupt
+        */
+        bool decode(const uint8_t* data, size_t size, uint16_t* depth, int stride) const
+        {
+            int width, height;
+            size_t encoded_size;
+            if (!info(data, size, width, height, encoded_size)) return false;
+            header h;
+            memcpy(&h, data, sizeof(h));
+
+            if (h.flags & RAW)
+            {
+                for (int y = 0; y < height; ++y)
+                    memcpy(reinterpret_cast<uint8_t*>(depth) + size_t(y) * stride, data + sizeof(h) + size_t(y) * width * 2, size_t(width) * 2);
+                return true;
+            }
+
+            const int band_rows = int(h.band_rows);
+            if (band_rows <= 0 || int(h.bands) != (height + band_rows - 1) / band_rows) return false;
+            std::vector<size_t> offsets(h.bands + 1, sizeof(h) + sizeof(uint32_t) * h.bands);
+            for (uint32_t b = 0; b < h.bands; ++b)
+            {
+                uint32_t band_size;
+                memcpy(&band_size, data + sizeof(h) + sizeof(uint32_t) * b, sizeof(band_size));
+                offsets[b + 1] = offsets[b] + band_size;
+            }
+
+            std::atomic<bool> ok(true);
+            _executor.parallel_for(h.bands, [&](size_t b) {
+                const int first = int(b) * band_rows;
+                if (!decode_band(data + offsets[b], offsets[b + 1] - offsets[b], depth, width, first, std::min(height, first + band_rows), stride))
+                    ok = false;
+            }, _priority);
+            return ok;
+        }
+
+    private:
+        static const uint32_t MAGIC = 0x43445352;  // "RSDC"
+        static const uint32_t RAW = 1;
+
+        // Residuals 0-15 are coded as themselves, larger ones by their number of bits followed by the bits below the
+        // leading one, and runs of at least MIN_RUN zero residuals by the number of bits of their length
+        static const int LITERALS = 16;
+        static const int LARGE = LITERALS;              // 12 classes, residuals of 4 to 15 bits
+        static const int RUNS = LARGE + 12;             // 15 classes, runs of 2 to 16 bits
+        static const int SYMBOLS = RUNS + 15;
+        static const int MIN_RUN = 4;
+        static const uint32_t MAX_RUN = (1u << 17) - 1;
+        static const int MAX_CODE_LENGTH = 12;
+
+        struct header
+        {
+            uint32_t magic;
+            uint32_t width;
+            uint32_t height;
+            uint32_t band_rows;
+            uint32_t bands;
+            uint32_t flags;
+        };
+
+        static uint16_t zigzag(uint16_t r) { return uint16_t((r << 1) ^ (0 - (r >> 15))); }
+        static uint16_t unzigzag(uint16_t z) { return uint16_t((z >> 1) ^ (0 - (z & 1))); }
+
+        static int floor_log2(uint32_t v)
+        {
+            int k = 0;
+            while (v >> (k + 1)) ++k;
+            return k;
+        }
+
+        static uint16_t median_edge(uint16_t a, uint16_t b, uint16_t c)
+        {
+            const uint16_t mn = std::min(a, b), mx = std::max(a, b);
+            if (c >= mx) return mn;
+            if (c <= mn) return mx;
+            return uint16_t(a + b - c);
+        }
+
+        // Zigzag mapped prediction residuals of a row. The first row of a band is predicted from the left only
+        static void predict_row(const uint16_t* row, const uint16_t* up, int width, uint16_t* res)
+        {
+            if (width <= 0) return;
+            res[0] = zigzag(uint16_t(row[0] - (up ? up[0] : 0)));
+            int x = 1;
+#if defined(RS2_DEPTH_CODEC_SSE2)
+            // Unsigned 16-bit order through the signed comparisons of SSE2
+            const __m128i bias = _mm_set1_epi16(-32768);
+            for (; x + 8 <= width; x += 8)
+            {
+                const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x - 1));
+                const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x));
+                __m128i pred = a;
+                if (up)
+                {
+                    const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(up + x));
+                    const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(up + x - 1));
+                    const __m128i ab = _mm_xor_si128(a, bias), bb = _mm_xor_si128(b, bias), cb = _mm_xor_si128(c, bias);
+                    const __m128i mnb = _mm_min_epi16(ab, bb), mxb = _mm_max_epi16(ab, bb);
+                    const __m128i c_ge_max = _mm_andnot_si128(_mm_cmplt_epi16(cb, mxb), _mm_set1_epi16(-1));
+                    const __m128i c_le_min = _mm_andnot_si128(_mm_cmpgt_epi16(cb, mnb), _mm_set1_epi16(-1));
+                    const __m128i gradient = _mm_sub_epi16(_mm_add_epi16(a, b), c);
+                    const __m128i t = _mm_or_si128(_mm_and_si128(c_le_min, _mm_xor_si128(mxb, bias)), _mm_andnot_si128(c_le_min, gradient));
+                    pred = _mm_or_si128(_mm_and_si128(c_ge_max, _mm_xor_si128(mnb, bias)), _mm_andnot_si128(c_ge_max, t));
+                }
+                const __m128i r = _mm_sub_epi16(d, pred);
+                const __m128i z = _mm_xor_si128(_mm_slli_epi16(r, 1), _mm_srai_epi16(r, 15));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(res + x), z);
+            }
+#elif defined(RS2_DEPTH_CODEC_NEON)
+            for (; x + 8 <= width; x += 8)
+            {
+                const uint16x8_t a = vld1q_u16(row + x - 1);
+                const uint16x8_t d = vld1q_u16(row + x);
+                uint16x8_t pred = a;
+                if (up)
+                {
+                    const uint16x8_t b = vld1q_u16(up + x);
+                    const uint16x8_t c = vld1q_u16(up + x - 1);
+                    const uint16x8_t mn = vminq_u16(a, b), mx = vmaxq_u16(a, b);
+                    const uint16x8_t gradient = vsubq_u16(vaddq_u16(a, b), c);
+                    pred = vbslq_u16(vcgeq_u16(c, mx), mn, vbslq_u16(vcleq_u16(c, mn), mx, gradient));
+                }
+                const int16x8_t r = vreinterpretq_s16_u16(vsubq_u16(d, pred));
+                const int16x8_t z = veorq_s16(vshlq_n_s16(r, 1), vshrq_n_s16(r, 15));
+                vst1q_u16(res + x, vreinterpretq_u16_s16(z));
+            }
+#endif
+            for (; x < width; ++x)
+                res[x] = zigzag(uint16_t(row[x] - (up ? median_edge(row[x - 1], up[x], up[x - 1]) : row[x - 1])));
+        }
+
+        static void reconstruct_row(const uint16_t* res, const uint16_t* up, int width, uint16_t* row)
+        {
+            if (width <= 0) return;
+            row[0] = uint16_t((up ? up[0] : 0) + unzigzag(res[0]));
+            if (up)
+                for (int x = 1; x < width; ++x)
+                    row[x] = uint16_t(median_edge(row[x - 1], up[x], up[x - 1]) + unzigzag(res[x]));
+            else
+                for (int x = 1; x < width; ++x)
+                    row[x] = uint16_t(row[x - 1] + unzigzag(res[x]));
+        }
+
+        class bit_writer
+        {
+        public:
+            explicit bit_writer(std::vector<uint8_t>& out) : _out(out) {}
+
+            // MSB first, up to 24 bits at a time
+            void put(uint32_t bits, int count)
+            {
+                _acc = (_acc << count) | bits;
+                _count += count;
+                while (_count >= 8)
+                {
+                    _count -= 8;
+                    _out.push_back(uint8_t(_acc >> _count));
+                }
+            }
+
+            void flush()
+            {
+                if (_count) _out.push_back(uint8_t(_acc << (8 - _count)));
+                _count = 0;
+            }
+
+        private:
+            std::vector<uint8_t>& _out;
+            uint64_t _acc = 0;
+            int _count = 0;
+        };
+
+        class bit_reader
+        {
+        public:
+            bit_reader(const uint8_t* data, size_t size) : _data(data), _size(size) {}
+
+            uint32_t peek(int count)
+            {
+                while (_count < count)
+                {
+                    _acc = (_acc << 8) | (_pos < _size ? _data[_pos] : 0);
+                    ++_pos;
+                    _count += 8;
+                }
+                return uint32_t(_acc >> (_count - count)) & ((1u << count) - 1);
+            }
+
+            void skip(int count) { _count -= count; }
+
+            uint32_t get(int count)
+            {
+                if (!count) return 0;
+                const uint32_t v = peek(count);
+                skip(count);
+                return v;
+            }
+
+            // Reading past the end yields zeros; a valid stream never does
+            bool overrun() const { return _pos > _size + 8; }
+
+        private:
+            const uint8_t* _data;
+            size_t _size;
+            size_t _pos = 0;
+            uint64_t _acc = 0;
+            int _count = 0;
+        };
+
+        // Huffman code lengths for the symbol frequencies, limited to MAX_CODE_LENGTH by flattening the frequencies
+        static void code_lengths(std::vector<uint32_t> freq, uint8_t* lengths)
+        {
+            for (;;)
+            {
+                std::fill(lengths, lengths + SYMBOLS, 0);
+                std::vector<uint64_t> weight;
+                std::vector<int> parent, active;
+                for (int s = 0; s < SYMBOLS; ++s)
+                    if (freq[size_t(s)])
+                    {
+                        active.push_back(int(weight.size()));
+                        weight.push_back(freq[size_t(s)]);
+                        parent.push_back(-1);
+                    }
+                const int leaves = int(weight.size());
+                if (leaves <= 1)
+                {
+                    for (int s = 0; s < SYMBOLS; ++s)
+                        if (freq[size_t(s)]) lengths[s] = 1;
+                    return;
+                }
+
+                while (active.size() > 1)
+                {
+                    // At most SYMBOLS leaves, so selecting the two lightest by sorting is cheap
+                    std::sort(active.begin(), active.end(), [&](int a, int b) { return weight[size_t(a)] > weight[size_t(b)]; });
+                    const int a = active.back(); active.pop_back();
+                    const int b = active.back(); active.pop_back();
+                    const int node = int(weight.size());
+                    weight.push_back(weight[size_t(a)] + weight[size_t(b)]);
+                    parent.push_back(-1);
+                    parent[size_t(a)] = parent[size_t(b)] = node;
+                    active.push_back(node);
+                }
+
+                int longest = 0, leaf = 0;
+                for (int s = 0; s < SYMBOLS; ++s)
+                {
+                    if (!freq[size_t(s)]) continue;
+                    int depth = 0;
+                    for (int n = leaf++; parent[size_t(n)] >= 0; n = parent[size_t(n)]) ++depth;
+                    lengths[s] = uint8_t(depth);
+                    longest = std::max(longest, depth);
+                }
+                if (longest <= MAX_CODE_LENGTH) return;
+                for (auto& f : freq)
+                    if (f) f = (f + 1) / 2;
+            }
+        }
+
+        static void canonical_codes(const uint8_t* lengths, uint16_t* codes)
+        {
+            uint32_t code = 0;
+            for (int length = 1; length <= MAX_CODE_LENGTH; ++length)
+            {
+                for (int s = 0; s < SYMBOLS; ++s)
+                    if (lengths[s] == length) codes[s] = uint16_t(code++);
+                code <<= 1;
+            }
+        }
+
+        // A token is a symbol, the count of extra bits following its code and their value
+        static uint32_t token(int symbol, int bits, uint32_t extra) { return uint32_t(symbol) | uint32_t(bits) << 6 | extra << 11; }
+
+        static void tokenize(const uint16_t* res, size_t count, std::vector<uint32_t>& tokens)
+        {
+            for (size_t i = 0; i < count;)
+            {
+                if (!res[i])
+                {
+                    size_t j = i;
+                    while (j < count && !res[j]) ++j;
+                    size_t run = j - i;
+                    while (run >= size_t(MIN_RUN))
+                    {
+                        const uint32_t n = uint32_t(std::min<size_t>(run, MAX_RUN));
+                        const int k = floor_log2(n);
+                        tokens.push_back(token(RUNS + k - 2, k, n - (1u << k)));
+                        run -= n;
+                    }
+                    for (; run; --run) tokens.push_back(token(0, 0, 0));
+                    i = j;
+                    continue;
+                }
+                const uint32_t v = res[i++];
+                if (v < uint32_t(LITERALS)) tokens.push_back(token(int(v), 0, 0));
+                else
+                {
+                    const int k = floor_log2(v);
+                    tokens.push_back(token(LARGE + k - 4, k, v - (1u << k)));
+                }
+            }
+        }
+
+        void encode_band(const uint16_t* depth, int width, int first, int last, int stride, std::vector<uint8_t>& out) const
+        {
+            auto row_of = [&](int y) { return reinterpret_cast<const uint16_t*>(reinterpret_cast<const uint8_t*>(depth) + size_t(y) * stride); };
+            std::vector<uint16_t> res(size_t(width) * (last - first));
+            for (int y = first; y < last; ++y)
+                predict_row(row_of(y), y > first ? row_of(y - 1) : nullptr, width, &res[size_t(y - first) * width]);
+
+            std::vector<uint32_t> tokens;
+            tokens.reserve(res.size() / 2);
+            tokenize(res.data(), res.size(), tokens);
+
+            std::vector<uint32_t> freq(SYMBOLS, 0);
+            for (auto t : tokens) ++freq[t & 63];
+            uint8_t lengths[SYMBOLS];
+            uint16_t codes[SYMBOLS] = {};
+            code_lengths(freq, lengths);
+            canonical_codes(lengths, codes);
+
+            out.clear();
+            out.reserve(res.size());
+            bit_writer bits(out);
+            for (int s = 0; s < SYMBOLS; ++s) bits.put(lengths[s], 4);
+            for (auto t : tokens)
+            {
+                const int s = int(t & 63), extra_bits = int((t >> 6) & 31);
+                bits.put(codes[s], lengths[s]);
+                if (extra_bits) bits.put(t >> 11, extra_bits);
+            }
+            bits.flush();
+        }
+
+        bool decode_band(const uint8_t* data, size_t size, uint16_t* depth, int width, int first, int last, int stride) const
+        {
+            bit_reader bits(data, size);
+            uint8_t lengths[SYMBOLS];
+            uint16_t codes[SYMBOLS] = {};
+            for (int s = 0; s < SYMBOLS; ++s) lengths[s] = uint8_t(bits.get(4));
+            canonical_codes(lengths, codes);
+
+            // Every code, padded to the longest length, indexes the entries of its symbol
+            std::vector<uint16_t> table(size_t(1) << MAX_CODE_LENGTH, 0);
+            for (int s = 0; s < SYMBOLS; ++s)
+            {
+                if (!lengths[s]) continue;
+                if (lengths[s] > MAX_CODE_LENGTH) return false;
+                const int shift = MAX_CODE_LENGTH - lengths[s];
+                const size_t begin = size_t(codes[s]) << shift, end = begin + (size_t(1) << shift);
+                if (end > table.size()) return false;
+                for (size_t i = begin; i < end; ++i) table[i] = uint16_t(s << 4 | lengths[s]);
+            }
+
+            std::vector<uint16_t> res(size_t(width) * (last - first));
+            for (size_t i = 0; i < res.size();)
+            {
+                const uint16_t entry = table[bits.peek(MAX_CODE_LENGTH)];
+                const int length = entry & 15, s = entry >> 4;
+                if (!length || bits.overrun()) return false;
+                bits.skip(length);
+                if (s < LITERALS) res[i++] = uint16_t(s);
+                else if (s < RUNS)
+                {
+                    const int k = s - LARGE + 4;
+                    res[i++] = uint16_t((1u << k) + bits.get(k));
+                }
+                else
+                {
+                    const int k = s - RUNS + 2;
+                    const size_t n = (size_t(1) << k) + bits.get(k);
+                    if (n > res.size() - i) return false;
+                    std::fill(res.begin() + i, res.begin() + i + n, 0);
+                    i += n;
+                }
+            }
+
+            auto row_of = [&](int y) { return reinterpret_cast<uint16_t*>(reinterpret_cast<uint8_t*>(depth) + size_t(y) * stride); };
+            for (int y = first; y < last; ++y)
+                reconstruct_row(&res[size_t(y - first) * width], y > first ? row_of(y - 1) : nullptr, width, row_of(y));
+            return true;
+        }
+
+        int _band_rows;
+        executor& _executor;
+        executor::priority _priority;
+    };
+
+    /**
+    * Encodes depth frames with depth_codec. The encoded image is carried in a RAW8 frame of the depth stream, whose
+    * profile keeps the intrinsics of the depth stream; encoded_size tells how many of its bytes to store or send.
+    * Accepts depth frames or framesets; in the latter case the depth frame is replaced and the rest passes through.
+    */
+    class depth_lossless_encoder : public filter
+    {
+    public:
+        explicit depth_lossless_encoder(int band_rows = 32, executor& ex = executor::instance())
+            : filter([this](frame f, frame_source& s) { func(f, s); }), _codec(band_rows, ex)
+        {}
+
+        /**
+        * Bytes of the encoded image in a frame produced by the encoder, 0 for other frames
+        */
+        static size_t encoded_size(const frame& f)
+        {
+            int width, height;
+            size_t size;
+            if (!f || !depth_codec::info(static_cast<const uint8_t*>(f.get_data()), size_t(f.get_data_size()), width, height, size))
+                return 0;
+            return size;
+        }
+
+    private:
+        void func(frame data, frame_source& source)
+        {
+            auto fs = data.as<frameset>();
+            depth_frame depth = fs ? fs.get_depth_frame() : data.as<depth_frame>();
+            if (!depth || depth.get_profile().format() != RS2_FORMAT_Z16)
+            {
+                source.frame_ready(data);
+                return;
+            }
+
+            const int width = depth.get_width(), height = depth.get_height();
+            std::lock_guard<std::mutex> lock(_mutex);
+            _codec.encode(static_cast<const uint16_t*>(depth.get_data()), width, height, depth.get_stride_in_bytes(), _buffer);
+
+            // Rows of twice the depth width, enough of them for the largest encoded image
+            const int row_bytes = width * 2;
+            const int rows = int((_codec.max_encoded_size(width, height) + row_bytes - 1) / row_bytes);
+            auto profile = depth.get_profile().as<video_stream_profile>();
+            if (!_profile || _source_uid != profile.unique_id())
+            {
+                _profile = profile.clone(profile.stream_type(), profile.stream_index(), RS2_FORMAT_RAW8, row_bytes, rows, profile.get_intrinsics());
+                _source_uid = profile.unique_id();
+            }
+
+            auto res = source.allocate_video_frame(_profile, depth, 1, row_bytes, rows, row_bytes, RS2_EXTENSION_VIDEO_FRAME);
+            memcpy(const_cast<void*>(res.get_data()), _buffer.data(), _buffer.size());
+            source.frame_ready(fs ? replace_depth(fs, res, source) : res);
+        }
+
+        depth_codec _codec;
+        std::mutex _mutex;
+        std::vector<uint8_t> _buffer;
+        stream_profile _profile;
+        int _source_uid = -1;
+    };
+
+    /**
+    * Decodes the frames of depth_lossless_encoder back to Z16 depth frames. Other frames pass through.
+    */
+    class depth_lossless_decoder : public filter
+    {
+    public:
+        explicit depth_lossless_decoder(executor& ex = executor::instance())
+            : filter([this](frame f, frame_source& s) { func(f, s); }), _codec(32, ex)
+        {}
+
+    private:
+        void func(frame data, frame_source& source)
+        {
+            auto fs = data.as<frameset>();
+            if (!fs)
+            {
+                source.frame_ready(decode(data, source));
+                return;
+            }
+            std::vector<frame> frames;
+            for (auto f : fs) frames.push_back(decode(f, source));
+            source.frame_ready(source.allocate_composite_frame(frames));
+        }
+
+        frame decode(const frame& encoded, frame_source& source)
+        {
+            auto profile = encoded.get_profile().as<video_stream_profile>();
+            int width, height;
+            size_t size;
+            if (!profile || profile.format() != RS2_FORMAT_RAW8
+                || !depth_codec::info(static_cast<const uint8_t*>(encoded.get_data()), size_t(encoded.get_data_size()), width, height, size))
+                return encoded;
+
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (!_profile || _source_uid != profile.unique_id())
+            {
+                _profile = profile.clone(profile.stream_type(), profile.stream_index(), RS2_FORMAT_Z16, width, height, profile.get_intrinsics());
+                _source_uid = profile.unique_id();
+            }
+            auto res = source.allocate_video_frame(_profile, encoded, 2, width, height, width * 2, RS2_EXTENSION_DEPTH_FRAME);
+            if (!_codec.decode(static_cast<const uint8_t*>(encoded.get_data()), size, static_cast<uint16_t*>(const_cast<void*>(res.get_data())), width * 2))
+                log(RS2_LOG_SEVERITY_WARN, "Corrupt depth_lossless_encoder frame");
+            return res;
+        }
+
+        depth_codec _codec;
+        std::mutex _mutex;
+        stream_profile _profile;
+        int _source_uid = -1;
+    };
+}
+
+#endif
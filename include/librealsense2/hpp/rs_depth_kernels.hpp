@@ -0,0 +1,383 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2017 Intel Corporation. All Rights Reserved.
+
+#ifndef LIBREALSENSE_RS2_DEPTH_KERNELS_HPP
+#define LIBREALSENSE_RS2_DEPTH_KERNELS_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <algorithm>
+#include "../h/rs_types.h"
+
+namespace rs2
+{
+    /**
+    * Scale camera intrinsics to a viewport that is smaller by an integer factor.
+    * Pixel centers are preserved, so a point projected with the scaled intrinsics lands on
+    * pixel (x / factor, y / factor) of the original viewport.
+    */
+    inline rs2_intrinsics scale_intrinsics(const rs2_intrinsics& intr, int factor)
+    {
+        rs2_intrinsics res = intr;
+        res.width = intr.width / factor;
+        res.height = intr.height / factor;
+        res.fx = intr.fx / factor;
+        res.fy = intr.fy / factor;
+        res.ppx = (intr.ppx + 0.5f) / factor - 0.5f;
+        res.ppy = (intr.ppy + 0.5f) / factor - 0.5f;
+        return res;
+    }
+
+    /**
+    * Row kernels of the depth post-processing chain.
+    * Every kernel works on a single row (or a pair of neighbouring rows), so that callers are free to
+    * run the stages frame by frame, or to interleave them band by band while the data is still in cache.
+    * Values are kept in a float working domain, which is either raw depth units or disparity.
+    */
+    namespace kernels
+    {
+        // Disparity is expressed in 1/32 pixel units, the sub-pixel resolution of the D400 family,
+        // so that smoothing deltas have the same meaning as on rs2::spatial_filter and rs2::temporal_filter
+        static const float DISPARITY_SUBPIXEL = 32.f;
+
+        /**
+        * Compute one row of a decimated Z16 image
+        * \param[in] src        First of the magnitude source rows
+        * \param[in] src_width  Width of the source image in pixels (also the row stride)
+        * \param[in] magnitude  Decimation factor. Blocks of up to 3x3 use the median of valid pixels, larger blocks their mean
+        * \param[out] dst       Output row of src_width / magnitude pixels
+        */
+        inline void decimate_row(const uint16_t* src, int src_width, int magnitude, uint16_t* dst)
+        {
+            const int dst_width = src_width / magnitude;
+            if (magnitude == 1)
+            {
+                memcpy(dst, src, dst_width * sizeof(uint16_t));
+                return;
+            }
+
+            std::array<uint16_t, 8 * 8> block;
+            for (int x = 0; x < dst_width; ++x)
+            {
+                int valid = 0;
+                uint32_t sum = 0;
+                for (int j = 0; j < magnitude; ++j)
+                {
+                    auto in = src + j * src_width + x * magnitude;
+                    for (int i = 0; i < magnitude; ++i)
+                    {
+                        if (in[i])
+                        {
+                            block[valid++] = in[i];
+                            sum += in[i];
+                        }
+                    }
+                }
+
+                if (!valid)
+                    dst[x] = 0;
+                else if (magnitude > 3)
+                    dst[x] = static_cast<uint16_t>(sum / valid);
+                else
+                {
+                    std::nth_element(block.begin(), block.begin() + valid / 2, block.begin() + valid);
+                    dst[x] = block[valid / 2];
+                }
+            }
+        }
+
+        /**
+        * Invalidate pixels outside of [min_z, max_z], both given in raw depth units
+        */
+        inline void threshold_row(uint16_t* row, int width, float min_z, float max_z)
+        {
+            for (int x = 0; x < width; ++x)
+                if (row[x] < min_z || row[x] > max_z) row[x] = 0;
+        }
+
+        /**
+        * Convert raw depth to the float working domain. With d2d != 0 the output is disparity, d2d / depth
+        */
+        inline void to_working_row(const uint16_t* in, float* out, int width, float d2d)
+        {
+            if (d2d)
+            {
+                for (int x = 0; x < width; ++x)
+                    out[x] = in[x] ? d2d / in[x] : 0.f;
+            }
+            else
+            {
+                for (int x = 0; x < width; ++x)
+                    out[x] = in[x];
+            }
+        }
+
+        /**
+        * Convert the float working domain back to raw depth. With d2d != 0 the input is disparity
+        */
+        inline void from_working_row(const float* in, uint16_t* out, int width, float d2d)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                float z = in[x];
+                if (d2d && z > 0) z = d2d / z;
+                out[x] = (z > 0) ? static_cast<uint16_t>(std::min(z + 0.5f, 65535.f)) : 0;
+            }
+        }
+
+        /**
+        * One edge-preserving recursive step: blend a valid value with its already filtered, valid
+        * neighbour unless they differ by delta or more (an edge)
+        */
+        inline float recursive_blend(float cur, float prev, float alpha, float delta)
+        {
+            if (cur > 0 && prev > 0 && std::fabs(cur - prev) < delta)
+                return alpha * cur + (1.f - alpha) * prev;
+            return cur;
+        }
+
+        /**
+        * Horizontal pass of the spatial filter: left to right followed by right to left
+        */
+        inline void spatial_horizontal_row(float* row, int width, float alpha, float delta)
+        {
+            for (int x = 1; x < width; ++x)
+                row[x] = recursive_blend(row[x], row[x - 1], alpha, delta);
+            for (int x = width - 2; x >= 0; --x)
+                row[x] = recursive_blend(row[x], row[x + 1], alpha, delta);
+        }
+
+        /**
+        * Vertical step of the spatial filter: filters row against its already filtered neighbour.
+        * Applying it from the top row down and then from the bottom row up forms the vertical pass.
+        */
+        inline void spatial_vertical_step(const float* neighbour, float* row, int width, float alpha, float delta)
+        {
+            for (int x = 0; x < width; ++x)
+                row[x] = recursive_blend(row[x], neighbour[x], alpha, delta);
+        }
+
+        /**
+        * Radius (in pixels) of the spatial filter's RS2_OPTION_HOLES_FILL modes: 0 - disabled, 1..4 - 2, 4, 8 and 16 pixels, 5 - unlimited
+        */
+        inline int spatial_holes_fill_radius(int mode)
+        {
+            static const int radius[] = { 0, 2, 4, 8, 16, 1 << 30 };
+            return radius[std::max(0, std::min(mode, 5))];
+        }
+
+        /**
+        * Fill invalid pixels with the closest valid pixel to their left, up to radius pixels away
+        */
+        inline void holes_fill_row(float* row, int width, int radius)
+        {
+            if (!radius) return;
+            float last = 0.f;
+            int distance = 0;
+            for (int x = 0; x < width; ++x)
+            {
+                if (row[x] > 0)
+                {
+                    last = row[x];
+                    distance = 0;
+                }
+                else if (last > 0 && ++distance <= radius)
+                {
+                    row[x] = last;
+                }
+            }
+        }
+
+        /**
+        * Persistence rules of the temporal filter's RS2_OPTION_HOLES_FILL modes.
+        * Entry i tells whether a missing pixel is replaced by its last value, given validity bitmask i of the previous 8 frames
+        * (bit 0 is the most recent frame).
+        */
+        class persistence_table
+        {
+        public:
+            explicit persistence_table(int mode = 3)
+            {
+                // {history mask, minimal number of valid frames within the mask}
+                static const int rules[9][2] = {
+                    { 0x00, 1 }, // 0 - disabled
+                    { 0xFF, 8 }, // 1 - valid in 8/8
+                    { 0x07, 2 }, // 2 - valid in 2/last 3
+                    { 0x0F, 2 }, // 3 - valid in 2/last 4
+                    { 0xFF, 2 }, // 4 - valid in 2/8
+                    { 0x03, 1 }, // 5 - valid in 1/last 2
+                    { 0x1F, 1 }, // 6 - valid in 1/last 5
+                    { 0xFF, 1 }, // 7 - valid in 1/8
+                    { 0x00, 0 }  // 8 - persist indefinitely
+                };
+                mode = std::max(0, std::min(mode, 8));
+                for (int i = 0; i < 256; ++i)
+                {
+                    int count = 0;
+                    for (int b = 0; b < 8; ++b)
+                        if ((i & rules[mode][0]) & (1 << b)) ++count;
+                    _table[i] = count >= rules[mode][1];
+                }
+                _mode = mode;
+            }
+
+            int mode() const { return _mode; }
+            bool operator[](uint8_t history) const { return _table[history]; }
+
+        private:
+            std::array<bool, 256> _table;
+            int _mode;
+        };
+
+        /**
+        * Temporal filter over one row
+        * \param[in,out] row       Current values, replaced by the filtered result
+        * \param[in,out] last      Filtered values of the previous frame
+        * \param[in,out] history   Validity bitmask of the previous 8 frames per pixel
+        */
+        inline void temporal_row(float* row, float* last, uint8_t* history, int width,
+            float alpha, float delta, const persistence_table& persistence)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                const float cur = row[x];
+                const float prev = last[x];
+                const bool valid = cur > 0;
+                float out = cur;
+                if (valid)
+                {
+                    if (prev > 0 && std::fabs(cur - prev) < delta)
+                        out = alpha * cur + (1.f - alpha) * prev;
+                }
+                else if (prev > 0 && persistence[history[x]])
+                {
+                    out = prev;
+                }
+                history[x] = static_cast<uint8_t>((history[x] << 1) | (valid ? 1 : 0));
+                row[x] = out;
+                last[x] = out;
+            }
+        }
+
+        /*
+        * 16-bit fixed-point working domain.
+        * The overloads below take uint16_t rows and halve the memory traffic of the float domain. In the depth domain values are
+        * raw depth units, unchanged. In the disparity domain values are disparity in 1/(32 * DISPARITY16_SCALE) pixel units,
+        * i.e. 1/128 pixel: the rounding error of a conversion is at most 1/256 pixel of disparity, and disparities above
+        * 65535 / 128 = 511.99 pixels (closer than about 0.06 m for a 50 mm baseline at 640 pixels focal length) saturate.
+        * Smoothing deltas and d2d passed to these kernels must be scaled by DISPARITY16_SCALE in the disparity domain,
+        * and blending weights are quantized to 1/256.
+        */
+        static const float DISPARITY16_SCALE = 4.f;
+
+        /**
+        * Convert raw depth to the 16-bit working domain. With d2d != 0 the output is fixed-point disparity, d2d / depth
+        */
+        inline void to_working_row(const uint16_t* in, uint16_t* out, int width, float d2d)
+        {
+            if (d2d)
+            {
+                for (int x = 0; x < width; ++x)
+                    out[x] = in[x] ? static_cast<uint16_t>(std::min(d2d / in[x] + 0.5f, 65535.f)) : 0;
+            }
+            else
+            {
+                memcpy(out, in, width * sizeof(uint16_t));
+            }
+        }
+
+        /**
+        * Convert the 16-bit working domain back to raw depth. With d2d != 0 the input is fixed-point disparity
+        */
+        inline void from_working_row(const uint16_t* in, uint16_t* out, int width, float d2d)
+        {
+            if (d2d)
+            {
+                for (int x = 0; x < width; ++x)
+                    out[x] = in[x] ? static_cast<uint16_t>(std::min(d2d / in[x] + 0.5f, 65535.f)) : 0;
+            }
+            else
+            {
+                memcpy(out, in, width * sizeof(uint16_t));
+            }
+        }
+
+        /**
+        * Blending weight alpha in 1/256 units
+        */
+        inline int fixed_alpha(float alpha)
+        {
+            return static_cast<int>(std::max(0.f, std::min(alpha, 1.f)) * 256.f + 0.5f);
+        }
+
+        /**
+        * recursive_blend for the 16-bit domain, alpha in 1/256 units.
+        * Ties round towards the current value: always rounding them up would accumulate along the recursion.
+        */
+        inline uint16_t recursive_blend(uint16_t cur, uint16_t prev, int alpha, int delta)
+        {
+            if (cur && prev && std::abs(int(cur) - int(prev)) < delta)
+                return static_cast<uint16_t>((alpha * cur + (256 - alpha) * prev + (cur > prev ? 128 : 127)) >> 8);
+            return cur;
+        }
+
+        inline void spatial_horizontal_row(uint16_t* row, int width, float alpha, float delta)
+        {
+            const int a = fixed_alpha(alpha), d = static_cast<int>(std::ceil(delta));
+            for (int x = 1; x < width; ++x)
+                row[x] = recursive_blend(row[x], row[x - 1], a, d);
+            for (int x = width - 2; x >= 0; --x)
+                row[x] = recursive_blend(row[x], row[x + 1], a, d);
+        }
+
+        inline void spatial_vertical_step(const uint16_t* neighbour, uint16_t* row, int width, float alpha, float delta)
+        {
+            const int a = fixed_alpha(alpha), d = static_cast<int>(std::ceil(delta));
+            for (int x = 0; x < width; ++x)
+                row[x] = recursive_blend(row[x], neighbour[x], a, d);
+        }
+
+        inline void holes_fill_row(uint16_t* row, int width, int radius)
+        {
+            if (!radius) return;
+            uint16_t last = 0;
+            int distance = 0;
+            for (int x = 0; x < width; ++x)
+            {
+                if (row[x])
+                {
+                    last = row[x];
+                    distance = 0;
+                }
+                else if (last && ++distance <= radius)
+                {
+                    row[x] = last;
+                }
+            }
+        }
+
+        inline void temporal_row(uint16_t* row, uint16_t* last, uint8_t* history, int width,
+            float alpha, float delta, const persistence_table& persistence)
+        {
+            const int a = fixed_alpha(alpha), d = static_cast<int>(std::ceil(delta));
+            for (int x = 0; x < width; ++x)
+            {
+                const uint16_t cur = row[x];
+                const uint16_t prev = last[x];
+                const bool valid = cur != 0;
+                uint16_t out = cur;
+                if (valid)
+                    out = recursive_blend(cur, prev, a, d);
+                else if (prev && persistence[history[x]])
+                    out = prev;
+                history[x] = static_cast<uint8_t>((history[x] << 1) | (valid ? 1 : 0));
+                row[x] = out;
+                last[x] = out;
+            }
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,254 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2017 Intel Corporation. All Rights Reserved.
+
+#ifndef LIBREALSENSE_RS2_EXECUTOR_HPP
+#define LIBREALSENSE_RS2_EXECUTOR_HPP
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <string>
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+#include "../rs.hpp"
+#include "rs_thread_policy.hpp"
+
+namespace rs2
+{
+    /**
+    * Work-stealing thread pool shared by processing blocks and pipelines of the whole process.
+    * Every worker owns a queue per priority level. Work submitted from a worker goes to its own queue, where it is likely
+    * to find its data still in cache; other work is spread over the workers. Idle workers steal the oldest work queued on
+    * other workers. Higher priority work always runs first, so a latency-critical camera can be given precedence
+    * over the others. With a single executor the number of processing threads matches the number of cores, however
+    * many cameras are attached.
+    */
+    class executor
+    {
+    public:
+        enum class priority
+        {
+            high,
+            normal,
+            low
+        };
+
+        struct statistics
+        {
+            uint64_t executed;      // Tasks run to completion
+            uint64_t stolen;        // Tasks run by a worker other than the one they were queued on
+            size_t pending;         // Tasks waiting to run
+        };
+
+        /**
+        * \param[in] threads  Number of workers, zero for one per CPU of the policy, or per hardware thread
+        * \param[in] policy   Applied to every worker, numbered by suffixing the name with the worker index
+        */
+        explicit executor(size_t threads = 0, thread_policy policy = thread_policy())
+        {
+            if (!threads) threads = policy.cpus.empty() ? std::max(1u, std::thread::hardware_concurrency()) : policy.cpus.size();
+            for (size_t i = 0; i < threads; ++i)
+                _workers.emplace_back(new worker());
+            for (size_t i = 0; i < threads; ++i)
+                _workers[i]->thread = std::thread([this, i, policy]() {
+                    if (!policy.empty()) policy.apply(std::to_string(i));
+                    run(i);
+                });
+        }
+
+        /**
+        * Stop the workers once the queued tasks have run
+        */
+        ~executor()
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _stopping = true;
+            }
+            _wake.notify_all();
+            for (auto& w : _workers)
+                w->thread.join();
+        }
+
+        executor(const executor&) = delete;
+        executor& operator=(const executor&) = delete;
+
+        /**
+        * Process-wide executor. It is intentionally never destroyed, since processing blocks may submit work during static destruction.
+        */
+        static executor& instance()
+        {
+            static executor* ex = new executor(0, instance_policy());
+            return *ex;
+        }
+
+        /**
+        * Thread policy of the process-wide executor, e.g. the CPUs reserved for processing.
+        * Only takes effect if modified before instance() is first called.
+        */
+        static thread_policy& instance_policy()
+        {
+            static thread_policy policy;
+            return policy;
+        }
+
+        /**
+        * Queue a task. An exception escaping the task is logged and does not stop the worker
+        */
+        void submit(std::function<void()> task, priority p = priority::normal)
+        {
+            auto& current = current_worker();
+            const size_t index = (current.first == this) ? current.second
+                : (_next_worker++ % _workers.size());
+            {
+                auto& w = *_workers[index];
+                std::lock_guard<std::mutex> lock(w.mutex);
+                w.queues[size_t(p)].push_back(std::move(task));
+            }
+            ++_pending;
+            if (_sleeping.load())
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _wake.notify_one();
+            }
+        }
+
+        /**
+        * Run body(i) for every i in [0, count) on the workers and the calling thread, and return once all of it ran,
+        * rethrowing the first error. The calling thread takes work too, so a task of this executor may call it without
+        * tying up a worker, and tasks helping after all work was taken return without touching body.
+        */
+        template<class F>
+        void parallel_for(size_t count, F body, priority p = priority::normal)
+        {
+            struct state
+            {
+                std::mutex m;
+                std::condition_variable done;
+                std::exception_ptr error;
+                std::atomic<size_t> next{ 0 };
+                size_t remaining;
+            };
+            auto s = std::make_shared<state>();
+            s->remaining = count;
+            auto work = [s, count, &body]() {
+                for (size_t i = s->next++; i < count; i = s->next++)
+                {
+                    std::exception_ptr e;
+                    try { body(i); }
+                    catch (...) { e = std::current_exception(); }
+                    std::lock_guard<std::mutex> lock(s->m);
+                    if (e && !s->error) s->error = e;
+                    if (!--s->remaining) s->done.notify_one();
+                }
+            };
+            const size_t helpers = std::min(count, threads()) - (count ? 1 : 0);
+            for (size_t i = 0; i < helpers; ++i)
+                submit(work, p);
+            work();
+            std::unique_lock<std::mutex> lock(s->m);
+            s->done.wait(lock, [&] { return s->remaining == 0; });
+            if (s->error) std::rethrow_exception(s->error);
+        }
+
+        size_t threads() const { return _workers.size(); }
+
+        statistics get_statistics() const
+        {
+            return{ _executed.load(), _stolen.load(), _pending.load() };
+        }
+
+    private:
+        static const size_t PRIORITIES = 3;
+
+        struct worker
+        {
+            std::mutex mutex;
+            std::deque<std::function<void()>> queues[PRIORITIES];
+            std::thread thread;
+        };
+
+        // Executor and worker index of the calling thread
+        static std::pair<const executor*, size_t>& current_worker()
+        {
+            static thread_local std::pair<const executor*, size_t> current{ nullptr, 0 };
+            return current;
+        }
+
+        bool take(size_t self, std::function<void()>& task)
+        {
+            for (size_t p = 0; p < PRIORITIES; ++p)
+            {
+                // Own work first, newest first while it is still in cache
+                {
+                    auto& w = *_workers[self];
+                    std::lock_guard<std::mutex> lock(w.mutex);
+                    if (!w.queues[p].empty())
+                    {
+                        task = std::move(w.queues[p].back());
+                        w.queues[p].pop_back();
+                        return true;
+                    }
+                }
+                // Then steal the oldest work of the others
+                for (size_t i = 1; i < _workers.size(); ++i)
+                {
+                    auto& w = *_workers[(self + i) % _workers.size()];
+                    std::lock_guard<std::mutex> lock(w.mutex);
+                    if (!w.queues[p].empty())
+                    {
+                        task = std::move(w.queues[p].front());
+                        w.queues[p].pop_front();
+                        ++_stolen;
+                        return true;
+                    }
+                }
+            }
+            return false;
+        }
+
+        void run(size_t self)
+        {
+            current_worker() = { this, self };
+            std::function<void()> task;
+            for (;;)
+            {
+                if (take(self, task))
+                {
+                    --_pending;
+                    try { task(); }
+                    catch (const std::exception& e) { log(RS2_LOG_SEVERITY_ERROR, e.what()); }
+                    catch (...) { log(RS2_LOG_SEVERITY_ERROR, "Unknown exception in executor task"); }
+                    task = nullptr;
+                    ++_executed;
+                    continue;
+                }
+
+                std::unique_lock<std::mutex> lock(_mutex);
+                ++_sleeping;
+                _wake.wait(lock, [&] { return _stopping || _pending.load() > 0; });
+                --_sleeping;
+                if (_stopping && !_pending.load()) return;
+            }
+        }
+
+        std::vector<std::unique_ptr<worker>> _workers;
+        std::atomic<size_t> _next_worker{ 0 };
+        std::atomic<size_t> _pending{ 0 };
+        std::atomic<int> _sleeping{ 0 };
+        std::atomic<uint64_t> _executed{ 0 };
+        std::atomic<uint64_t> _stolen{ 0 };
+        std::mutex _mutex;
+        std::condition_variable _wake;
+        bool _stopping = false;
+    };
+}
+
+#endif
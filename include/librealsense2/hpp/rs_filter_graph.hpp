@@ -0,0 +1,399 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2017 Intel Corporation. All Rights Reserved.
+
+#ifndef LIBREALSENSE_RS2_FILTER_GRAPH_HPP
+#define LIBREALSENSE_RS2_FILTER_GRAPH_HPP
+
+#include <deque>
+#include <algorithm>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <vector>
+#include <functional>
+#include <stdexcept>
+#include <condition_variable>
+#include <initializer_list>
+#include "rs_frame.hpp"
+#include "rs_frame_ring.hpp"
+#include "rs_executor.hpp"
+
+namespace rs2
+{
+    /**
+    * Bounded FIFO connecting exactly one producer to one consumer thread.
+    * On overflow it applies its policy: block holds the producer back, drop_newest refuses the arriving frame at its source,
+    * drop_oldest discards the frame that waited longest. Every discarded frame is counted.
+    */
+    class stage_queue
+    {
+    public:
+        stage_queue(size_t capacity, overflow_policy policy) : _capacity(std::max<size_t>(capacity, 1)), _policy(policy) {}
+
+        /**
+        * Push a frame. Returns false if the queue was closed, in which case the frame is counted as discarded.
+        */
+        bool enqueue(frame f)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (_policy == overflow_policy::block)
+                _not_full.wait(lock, [&] { return _closed || _queue.size() < _capacity; });
+            if (_closed)
+            {
+                ++_discarded;
+                return false;
+            }
+
+            if (_queue.size() >= _capacity)
+            {
+                ++_dropped;
+                if (_policy == overflow_policy::drop_newest) return true;
+                _queue.pop_front();
+            }
+            _queue.push_back(std::move(f));
+            lock.unlock();
+            _not_empty.notify_one();
+            return true;
+        }
+
+        /**
+        * Wait for a frame. Returns false once the queue is closed and drained.
+        */
+        bool dequeue(frame& f)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _not_empty.wait(lock, [&] { return _closed || !_queue.empty(); });
+            if (_queue.empty()) return false;
+            f = std::move(_queue.front());
+            _queue.pop_front();
+            lock.unlock();
+            _not_full.notify_one();
+            return true;
+        }
+
+        /**
+        * Take a frame if one is queued, without waiting
+        */
+        bool try_dequeue(frame& f)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (_queue.empty()) return false;
+            f = std::move(_queue.front());
+            _queue.pop_front();
+            lock.unlock();
+            _not_full.notify_one();
+            return true;
+        }
+
+        void close()
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _closed = true;
+                _discarded += _queue.size();
+                _queue.clear();
+            }
+            _not_empty.notify_all();
+            _not_full.notify_all();
+        }
+
+        void reopen()
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _closed = false;
+        }
+
+        bool empty()
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _queue.empty();
+        }
+
+        uint64_t dropped() const { return _dropped; }
+
+        // Frames thrown away by close, or refused because the queue was closed
+        uint64_t discarded() const { return _discarded; }
+
+    private:
+        std::mutex _mutex;
+        std::condition_variable _not_empty;
+        std::condition_variable _not_full;
+        std::deque<frame> _queue;
+        size_t _capacity;
+        overflow_policy _policy;
+        bool _closed = false;
+        std::atomic<uint64_t> _dropped{ 0 };
+        std::atomic<uint64_t> _discarded{ 0 };
+    };
+
+    /**
+    * Runs a chain of filters as a pipeline: each stage (one filter, or a group of filters applied back to back)
+    * runs on its own worker thread and hands its output to the next stage through a bounded queue.
+    * Throughput is bound by the slowest stage rather than by the sum of all stages, while frames leave the graph
+    * in the order they entered it. The graph does not own the filters, which must outlive it.
+    * Instead of dedicated threads, the stages can run as tasks of a shared executor, so that the graphs of many cameras
+    * share one thread per core. Every stage still processes one frame at a time, in order.
+    *
+    * Backpressure is explicit: every stage queue has its own overflow_policy and counts the frames it drops, and with an
+    * admission limit the graph sheds load at its entrance, before any processing is spent on frames that would be
+    * dropped further down anyway.
+    */
+    class filter_graph
+    {
+    public:
+        struct stage_statistics
+        {
+            uint64_t processed;     // Frames that completed the stage
+            uint64_t dropped;       // Frames discarded by the stage's input queue
+            uint64_t errors;        // Frames discarded because a filter threw
+        };
+
+        /**
+        * \param[in] queue_size     Capacity of the queue in front of every stage
+        * \param[in] policy         Behavior of the queues when a stage falls behind
+        */
+        explicit filter_graph(size_t queue_size = 1, overflow_policy policy = overflow_policy::drop_oldest)
+            : _queue_size(queue_size), _policy(policy)
+        {}
+
+        ~filter_graph() { stop(); }
+
+        filter_graph(const filter_graph&) = delete;
+        filter_graph& operator=(const filter_graph&) = delete;
+
+        /**
+        * Append a stage running the given filters back to back on a dedicated worker. Must be called before start().
+        */
+        filter_graph& add_stage(std::initializer_list<std::reference_wrapper<const filter_interface>> filters)
+        {
+            return add_stage(filters, _policy);
+        }
+
+        /**
+        * Append a stage whose input queue applies its own overflow policy
+        */
+        filter_graph& add_stage(std::initializer_list<std::reference_wrapper<const filter_interface>> filters, overflow_policy policy)
+        {
+            if (policy == overflow_policy::block) _blocking = true;
+            std::unique_ptr<stage> s(new stage(_queue_size, policy));
+            for (auto& f : filters) s->filters.push_back(&f.get());
+            if (!_stages.empty()) _stages.back()->next = s.get();
+            _stages.push_back(std::move(s));
+            return *this;
+        }
+
+        /**
+        * Start the workers
+        * \param[in] on_frame  Receives the output of the last stage, in input order (e.g. a frame_queue)
+        */
+        template<class S>
+        void start(S on_frame)
+        {
+            stop();
+            _sink = on_frame;
+            _executor = nullptr;
+            for (auto& stage : _stages)
+            {
+                auto s = stage.get();
+                s->input.reopen();
+                s->worker = std::thread([this, s]() { run(*s); });
+            }
+        }
+
+        /**
+        * Start the graph on a shared executor instead of dedicated threads
+        * \param[in] on_frame  Receives the output of the last stage, in input order (e.g. a frame_queue)
+        * \param[in] ex        Executor running the stages, e.g. executor::instance()
+        * \param[in] p         Priority of this graph's work relative to other work on the executor
+        */
+        template<class S>
+        void start(S on_frame, executor& ex, executor::priority p = executor::priority::normal)
+        {
+            // A stage blocking on a full queue would hold an executor thread that others may need
+            if (_blocking)
+                throw std::invalid_argument("filter_graph on an executor requires a dropping overflow_policy");
+
+            stop();
+            _sink = on_frame;
+            _executor = &ex;
+            _priority = p;
+            for (auto& s : _stages) s->input.reopen();
+        }
+
+        /**
+        * Stop the workers, discarding frames still in flight
+        */
+        void stop()
+        {
+            for (auto& s : _stages) s->input.close();
+            for (auto& s : _stages)
+                if (s->worker.joinable()) s->worker.join();
+            // Tasks already submitted to the executor find their queue closed and return
+            while (_tasks.load()) std::this_thread::yield();
+        }
+
+        /**
+        * Limit the number of frames inside the graph. Frames arriving while the limit is reached are dropped at the
+        * entrance, so an overloaded graph sheds load before the first stage rather than after some of the processing.
+        * \param[in] frames  Maximum frames in flight, zero for no limit
+        */
+        void set_admission_limit(size_t frames) { _admission_limit = frames; }
+
+        /**
+        * Feed a frame to the first stage
+        */
+        void invoke(frame f)
+        {
+            if (_stages.empty())
+            {
+                if (_sink) _sink(std::move(f));
+                return;
+            }
+            const size_t limit = _admission_limit.load();
+            if (limit && in_flight() >= limit)
+            {
+                ++_shed;
+                return;
+            }
+            ++_admitted;
+            push(*_stages.front(), std::move(f));
+        }
+
+        void operator()(frame f) { invoke(std::move(f)); }
+
+        size_t stages() const { return _stages.size(); }
+
+        stage_statistics get_statistics(size_t index) const
+        {
+            auto& s = *_stages.at(index);
+            return{ s.processed.load(), s.input.dropped(), s.errors.load() };
+        }
+
+        /**
+        * Statistics of the entrance of the graph: frames admitted, and frames shed by the admission limit
+        */
+        stage_statistics get_input_statistics() const
+        {
+            return{ _admitted.load(), _shed.load(), 0 };
+        }
+
+        /**
+        * Frames admitted to the graph that have neither left it nor been dropped
+        */
+        size_t in_flight() const
+        {
+            uint64_t left = _completed.load();
+            for (auto& s : _stages)
+                left += s->input.dropped() + s->input.discarded() + s->errors.load();
+            const uint64_t admitted = _admitted.load();
+            return admitted > left ? size_t(admitted - left) : 0;
+        }
+
+    private:
+        struct stage
+        {
+            stage(size_t queue_size, overflow_policy policy) : input(queue_size, policy) {}
+
+            std::vector<const filter_interface*> filters;
+            stage_queue input;
+            std::thread worker;
+            stage* next = nullptr;                  // Stage fed by this one, null for the last
+            std::atomic<bool> scheduled{ false };
+            std::atomic<uint64_t> processed{ 0 };
+            std::atomic<uint64_t> errors{ 0 };
+        };
+
+        void run(stage& s)
+        {
+            frame f;
+            while (s.input.dequeue(f))
+                process(s, f);
+        }
+
+        // Never throws: a frame whose filters or sink throw is counted as an error of the stage
+        void process(stage& s, frame& f)
+        {
+            try
+            {
+                for (auto filter : s.filters)
+                    f = filter->process(f);
+            }
+            catch (...)
+            {
+                ++s.errors;
+                return;
+            }
+            ++s.processed;
+
+            if (s.next)
+                push(*s.next, std::move(f));
+            else
+            {
+                try { _sink(std::move(f)); }
+                catch (const std::exception& e)
+                {
+                    ++s.errors;
+                    log(RS2_LOG_SEVERITY_ERROR, e.what());
+                    return;
+                }
+                catch (...)
+                {
+                    ++s.errors;
+                    log(RS2_LOG_SEVERITY_ERROR, "Unknown exception in filter_graph sink");
+                    return;
+                }
+                ++_completed;
+            }
+        }
+
+        void push(stage& s, frame f)
+        {
+            if (!s.input.enqueue(std::move(f)) || !_executor) return;
+            schedule(s);
+        }
+
+        // At most one task per stage is queued or running, which keeps every stage sequential and in order
+        void schedule(stage& s)
+        {
+            if (s.scheduled.exchange(true)) return;
+            ++_tasks;
+            _executor->submit([this, &s]() { drain(s); }, _priority);
+        }
+
+        void drain(stage& s)
+        {
+            frame f;
+            // process does not throw, but whatever does (e.g. running out of memory) must not leave the stage scheduled,
+            // or stop() would wait for the task forever
+            try
+            {
+                while (s.input.try_dequeue(f))
+                    process(s, f);
+            }
+            catch (...)
+            {
+                ++s.errors;
+            }
+            s.scheduled = false;
+            // A frame may have arrived after the queue was found empty but before the flag was cleared
+            if (!s.input.empty()) schedule(s);
+            --_tasks;
+        }
+
+        size_t _queue_size;
+        overflow_policy _policy;
+        bool _blocking = false;
+        std::vector<std::unique_ptr<stage>> _stages;
+        std::function<void(frame)> _sink;
+        executor* _executor = nullptr;
+        executor::priority _priority = executor::priority::normal;
+        std::atomic<int> _tasks{ 0 };
+        std::atomic<size_t> _admission_limit{ 0 };
+        std::atomic<uint64_t> _admitted{ 0 };
+        std::atomic<uint64_t> _shed{ 0 };
+        std::atomic<uint64_t> _completed{ 0 };
+    };
+}
+
+#endif
@@ -0,0 +1,116 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2017 Intel Corporation. All Rights Reserved.
+
+#ifndef LIBREALSENSE_RS2_FILTER_TIMING_HPP
+#define LIBREALSENSE_RS2_FILTER_TIMING_HPP
+
+#include <array>
+#include <chrono>
+#include <cfloat>
+#include <algorithm>
+#include "rs_processing.hpp"
+
+namespace rs2
+{
+    /**
+    * Wraps a processing block and measures it. Timing and throughput are published through the options interface,
+    * so any code that can show or log options (e.g. a GUI built from filter options) can show the cost of the block:
+    *   OPTION_PROCESSING_TIME_LAST / _MEAN / _P99 - processing time in milliseconds, mean and 99th percentile over the last WINDOW frames
+    *   OPTION_FRAMES_IN / _OUT - frames passed to the block and frames it produced
+    *   OPTION_FRAMES_DROPPED - frames for which the block produced nothing or threw
+    * These options are updated by the block on every frame and are not meant to be set by the application.
+    * The wrapped block is not owned and must outlive the wrapper.
+    */
+    class instrumented_filter : public filter
+    {
+    public:
+        static const auto OPTION_PROCESSING_TIME_LAST = rs2_option(RS2_OPTION_COUNT + 30);
+        static const auto OPTION_PROCESSING_TIME_MEAN = rs2_option(RS2_OPTION_COUNT + 31);
+        static const auto OPTION_PROCESSING_TIME_P99 = rs2_option(RS2_OPTION_COUNT + 32);
+        static const auto OPTION_FRAMES_IN = rs2_option(RS2_OPTION_COUNT + 33);
+        static const auto OPTION_FRAMES_OUT = rs2_option(RS2_OPTION_COUNT + 34);
+        static const auto OPTION_FRAMES_DROPPED = rs2_option(RS2_OPTION_COUNT + 35);
+
+        static const size_t WINDOW = 128;
+
+        instrumented_filter(const filter_interface& inner)
+            : filter([this](frame f, frame_source& s) { func(f, s); }), _inner(&inner)
+        {
+            for (auto opt : { OPTION_PROCESSING_TIME_LAST, OPTION_PROCESSING_TIME_MEAN, OPTION_PROCESSING_TIME_P99,
+                              OPTION_FRAMES_IN, OPTION_FRAMES_OUT, OPTION_FRAMES_DROPPED })
+                register_simple_option(opt, option_range{ 0, FLT_MAX, 0, 0 });
+        }
+
+        /**
+        * Human readable name of the timing options, for GUI and logs
+        */
+        static const char* get_timing_option_name(rs2_option opt)
+        {
+            // Custom option values lie outside the enumeration, so switch on the integer
+            switch (int(opt))
+            {
+            case int(OPTION_PROCESSING_TIME_LAST): return "Last [ms]";
+            case int(OPTION_PROCESSING_TIME_MEAN): return "Mean [ms]";
+            case int(OPTION_PROCESSING_TIME_P99): return "P99 [ms]";
+            case int(OPTION_FRAMES_IN): return "Frames In";
+            case int(OPTION_FRAMES_OUT): return "Frames Out";
+            case int(OPTION_FRAMES_DROPPED): return "Frames Dropped";
+            default: return "Unknown";
+            }
+        }
+
+    private:
+        void func(frame data, frame_source& source)
+        {
+            set_option(OPTION_FRAMES_IN, float(++_in));
+
+            auto start = std::chrono::high_resolution_clock::now();
+            frame result;
+            try
+            {
+                result = _inner->process(data);
+            }
+            catch (...)
+            {
+                record(start, false);
+                throw;
+            }
+            record(start, bool(result));
+
+            if (result)
+                source.frame_ready(result);
+        }
+
+        void record(std::chrono::high_resolution_clock::time_point start, bool produced)
+        {
+            const float ms = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+            _samples[_next++ % WINDOW] = ms;
+            const size_t count = std::min<size_t>(_next, WINDOW);
+            float sum = 0;
+            for (size_t i = 0; i < count; ++i) sum += _samples[i];
+
+            std::array<float, WINDOW> sorted;
+            std::copy(_samples.begin(), _samples.begin() + count, sorted.begin());
+            const size_t p99 = (count * 99) / 100;
+            std::nth_element(sorted.begin(), sorted.begin() + p99, sorted.begin() + count);
+
+            set_option(OPTION_PROCESSING_TIME_LAST, ms);
+            set_option(OPTION_PROCESSING_TIME_MEAN, sum / count);
+            set_option(OPTION_PROCESSING_TIME_P99, sorted[p99]);
+            if (produced)
+                set_option(OPTION_FRAMES_OUT, float(++_out));
+            else
+                set_option(OPTION_FRAMES_DROPPED, float(++_dropped));
+        }
+
+        const filter_interface* _inner;
+        std::array<float, WINDOW> _samples;
+        size_t _next = 0;
+        unsigned long long _in = 0;
+        unsigned long long _out = 0;
+        unsigned long long _dropped = 0;
+    };
+}
+
+#endif
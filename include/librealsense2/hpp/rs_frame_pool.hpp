@@ -0,0 +1,201 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2017 Intel Corporation. All Rights Reserved.
+
+#ifndef LIBREALSENSE_RS2_FRAME_POOL_HPP
+#define LIBREALSENSE_RS2_FRAME_POOL_HPP
+
+#include <new>
+#include <map>
+#include <mutex>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include "../h/rs_sensor.h"
+
+namespace rs2
+{
+    /**
+    * Pool of frame payload buffers, keyed by size and format and shared by everything in the process that owns frame memory,
+    * e.g. lz4_recorder for the frames waiting for compression and lz4_playback for the decompressed frames it delivers.
+    * Output frames of processing blocks are allocated by the SDK and cannot come from the pool.
+    * Buffers go back to the pool when released, which for frames created through software_sensor::on_video_frame
+    * happens when the SDK releases the last reference to the frame: pass frame_buffer_pool::release as the frame deleter.
+    * Free lists are split across independently locked shards, one per thread: a buffer is released into the shard of the
+    * releasing thread and acquired from the shard of the acquiring thread first, so that pipelines running on different
+    * threads (e.g. one per camera, with identical stream configurations) do not contend on the same lock. Only when its
+    * own shard has no matching buffer does a thread look through the other shards.
+    */
+    class frame_buffer_pool
+    {
+    public:
+        struct statistics
+        {
+            uint64_t hits;              // Requests served from a free list
+            uint64_t misses;            // Requests that had to allocate
+            size_t outstanding;         // Buffers currently handed out
+            size_t high_water_mark;     // Maximum number of buffers handed out at once
+            size_t cached_bytes;        // Memory held in free lists
+        };
+
+        /**
+        * Create a pool
+        * \param[in] max_free_per_key   Upper bound on idle buffers kept for each (size, format) pair in each shard. Extra buffers are freed.
+        */
+        explicit frame_buffer_pool(size_t max_free_per_key = 16) : _max_free_per_key(max_free_per_key) {}
+
+        ~frame_buffer_pool()
+        {
+            for (auto& shard : _shards)
+                for (auto& bucket : shard.buckets)
+                    for (auto h : bucket.second)
+                        ::operator delete(h);
+        }
+
+        frame_buffer_pool(const frame_buffer_pool&) = delete;
+        frame_buffer_pool& operator=(const frame_buffer_pool&) = delete;
+
+        /**
+        * Process-wide pool. It is intentionally never destroyed, since frames may be released after static destructors have run.
+        */
+        static frame_buffer_pool& instance()
+        {
+            static frame_buffer_pool* pool = new frame_buffer_pool();
+            return *pool;
+        }
+
+        /**
+        * Acquire a payload of size bytes, aligned like memory returned by operator new
+        * \param[in] size       Payload size in bytes
+        * \param[in] format     Payload format, buffers are only reused between requests of the same format
+        * \return pointer to be released with frame_buffer_pool::release
+        */
+        void* acquire(size_t size, rs2_format format = RS2_FORMAT_ANY)
+        {
+            const key k{ size, format };
+            const size_t own = thread_shard();
+            header* h = take(_shards[own], k);
+            for (size_t i = 1; !h && i < SHARDS; ++i)
+                h = take(_shards[(own + i) % SHARDS], k);
+
+            if (h)
+            {
+                ++_hits;
+                _cached_bytes -= size;
+            }
+            else
+            {
+                ++_misses;
+                h = static_cast<header*>(::operator new(sizeof(header) + size));
+                h->pool = this;
+                h->k = k;
+            }
+
+            auto outstanding = ++_outstanding;
+            auto high = _high_water_mark.load();
+            while (outstanding > high && !_high_water_mark.compare_exchange_weak(high, outstanding)) {}
+
+            return h + 1;
+        }
+
+        /**
+        * Return a payload to the pool it was acquired from.
+        * Signature matches the deleter of rs2_software_video_frame and rs2_software_motion_frame.
+        */
+        static void release(void* payload)
+        {
+            if (!payload) return;
+            auto h = static_cast<header*>(payload) - 1;
+            h->pool->recycle(h);
+        }
+
+        /**
+        * Acquire a buffer of count elements of T, returned to the pool when the last shared_ptr goes away.
+        * Used by processing blocks for working memory that does not outlive a single frame.
+        */
+        template<class T>
+        std::shared_ptr<T> lease(size_t count, rs2_format format = RS2_FORMAT_ANY)
+        {
+            return std::shared_ptr<T>(static_cast<T*>(acquire(count * sizeof(T), format)), [](T* p) { release(p); });
+        }
+
+        statistics get_statistics() const
+        {
+            return{ _hits.load(), _misses.load(), _outstanding.load(), _high_water_mark.load(), _cached_bytes.load() };
+        }
+
+    private:
+        struct key
+        {
+            size_t size;
+            rs2_format format;
+            bool operator<(const key& other) const
+            {
+                return size < other.size || (size == other.size && format < other.format);
+            }
+        };
+
+        // Placed in front of every payload; padded so that payloads keep the alignment of operator new
+        struct alignas(alignof(std::max_align_t)) header
+        {
+            frame_buffer_pool* pool;
+            key k;
+        };
+
+        struct shard
+        {
+            std::mutex mutex;
+            std::map<key, std::vector<header*>> buckets;
+        };
+
+        static const size_t SHARDS = 16;
+
+        // Threads get shards in turn, so the first SHARDS threads never share one
+        static size_t thread_shard()
+        {
+            static std::atomic<size_t> next{ 0 };
+            static thread_local size_t index = next++ % SHARDS;
+            return index;
+        }
+
+        static header* take(shard& s, const key& k)
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            auto it = s.buckets.find(k);
+            if (it == s.buckets.end() || it->second.empty()) return nullptr;
+            header* h = it->second.back();
+            it->second.pop_back();
+            return h;
+        }
+
+        void recycle(header* h)
+        {
+            --_outstanding;
+            auto& shard = _shards[thread_shard()];
+            {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                auto& bucket = shard.buckets[h->k];
+                if (bucket.size() < _max_free_per_key)
+                {
+                    bucket.push_back(h);
+                    _cached_bytes += h->k.size;
+                    return;
+                }
+            }
+            ::operator delete(h);
+        }
+
+        size_t _max_free_per_key;
+        shard _shards[SHARDS];
+        std::atomic<uint64_t> _hits{ 0 };
+        std::atomic<uint64_t> _misses{ 0 };
+        std::atomic<size_t> _outstanding{ 0 };
+        std::atomic<size_t> _high_water_mark{ 0 };
+        std::atomic<size_t> _cached_bytes{ 0 };
+    };
+}
+
+#endif
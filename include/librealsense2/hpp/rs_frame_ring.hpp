@@ -0,0 +1,323 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2017 Intel Corporation. All Rights Reserved.
+
+#ifndef LIBREALSENSE_RS2_FRAME_RING_HPP
+#define LIBREALSENSE_RS2_FRAME_RING_HPP
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+#include <condition_variable>
+#include "rs_frame.hpp"
+
+namespace rs2
+{
+    /**
+    * What a bounded queue does when a frame arrives and the queue is full
+    */
+    enum class overflow_policy
+    {
+        block,          // Wait for the consumer, pushing back on the producer
+        drop_oldest,    // Discard the oldest queued frame to make room, keeping latency bounded
+        drop_newest     // Discard the arriving frame, keeping the frames already queued
+    };
+
+    /**
+    * Bounded frame queue for handing frames between threads, built on a lock-free ring.
+    * Unlike frame_queue it reports what happens inside: how many frames went through, how many were dropped on overflow
+    * or coalesced, and how long frames waited in the queue. With coalescing enabled, a frame is discarded at dequeue time
+    * if a newer frame of the same stream was queued after it, so the consumer always sees the latest frame of every stream.
+    * Enqueueing and polling never take a lock; a lock is only used to put a consumer to sleep in wait_for_frame.
+    * Like frame_queue, copies of the object share the same queue, so it can be passed by value as the callback of
+    * processing_block::start, filter_graph::start or pipeline::start.
+    */
+    class frame_ring_queue
+    {
+    public:
+        struct statistics
+        {
+            uint64_t enqueued;      // Frames accepted by the queue
+            uint64_t dequeued;      // Frames handed to the consumer
+            uint64_t dropped;       // Frames discarded on overflow
+            uint64_t coalesced;     // Frames discarded because a newer frame of the same stream followed them
+            float age_last_ms;      // Time the last dequeued frame spent in the queue
+            float age_mean_ms;      // Mean time in the queue of dequeued frames
+            float age_max_ms;       // Maximum time in the queue of dequeued frames
+        };
+
+        /**
+        * \param[in] capacity           Number of frames the queue holds
+        * \param[in] policy             drop_oldest or drop_newest; a lock-free queue cannot block the producer
+        * \param[in] coalesce_streams   Keep only the newest queued frame of every stream
+        */
+        explicit frame_ring_queue(size_t capacity = 1, overflow_policy policy = overflow_policy::drop_oldest, bool coalesce_streams = false)
+            : _impl(std::make_shared<impl>(capacity, policy, coalesce_streams))
+        {
+            if (policy == overflow_policy::block)
+                throw std::invalid_argument("frame_ring_queue does not support overflow_policy::block");
+        }
+
+        /**
+        * Enqueue a frame, applying the overflow policy if the queue is full
+        */
+        void enqueue(frame f) const
+        {
+            auto& q = *_impl;
+            const int slot = q.coalesce ? q.slot_of(f) : -1;
+            const int64_t now = impl::now_ns();
+            while (!q.try_push(f, slot, now))
+            {
+                if (q.policy == overflow_policy::drop_newest)
+                {
+                    ++q.dropped;
+                    return;
+                }
+                frame oldest;
+                if (q.try_pop(oldest, nullptr))
+                    ++q.dropped;
+            }
+            ++q.enqueued;
+            // The frame was published by a release store, which may otherwise be reordered after the load of waiters:
+            // a consumer registering as a waiter at that moment would not see the frame and would not be woken
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (q.waiters.load())
+            {
+                std::lock_guard<std::mutex> lock(q.mutex);
+                q.cv.notify_one();
+            }
+        }
+
+        void operator()(frame f) const { enqueue(std::move(f)); }
+
+        /**
+        * Dequeue a frame if one is available
+        * \return true if a frame was stored to output
+        */
+        template<typename T>
+        typename std::enable_if<std::is_base_of<rs2::frame, T>::value, bool>::type poll_for_frame(T* output) const
+        {
+            frame f;
+            if (!_impl->pop(f)) return false;
+            *output = f;
+            return true;
+        }
+
+        /**
+        * Wait up to timeout_ms for a frame
+        * \return true if a frame was stored to output
+        */
+        template<typename T>
+        typename std::enable_if<std::is_base_of<rs2::frame, T>::value, bool>::type try_wait_for_frame(T* output, unsigned int timeout_ms = 5000) const
+        {
+            auto& q = *_impl;
+            frame f;
+            if (!q.pop(f))
+            {
+                auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+                ++q.waiters;
+                // Pairs with the fence in enqueue: either the producer sees the waiter, or the pop below sees the frame
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                {
+                    std::unique_lock<std::mutex> lock(q.mutex);
+                    // Re-checked under the lock, so that a frame enqueued after the first attempt is not missed
+                    q.cv.wait_until(lock, deadline, [&] { return q.pop(f); });
+                }
+                --q.waiters;
+                if (!f) return false;
+            }
+            *output = f;
+            return true;
+        }
+
+        /**
+        * Wait up to timeout_ms for a frame, throwing if none arrives
+        */
+        frame wait_for_frame(unsigned int timeout_ms = 5000) const
+        {
+            frame f;
+            if (!try_wait_for_frame(&f, timeout_ms))
+                throw std::runtime_error("Frame didn't arrive within " + std::to_string(timeout_ms));
+            return f;
+        }
+
+        /**
+        * Approximate number of queued frames
+        */
+        size_t size() const
+        {
+            auto in = _impl->enqueue_pos.load(), out = _impl->dequeue_pos.load();
+            return in > out ? static_cast<size_t>(in - out) : 0;
+        }
+
+        size_t capacity() const { return _impl->cells.size(); }
+
+        statistics get_statistics() const
+        {
+            auto& q = *_impl;
+            const uint64_t dequeued = q.dequeued.load();
+            return{ q.enqueued.load(), dequeued, q.dropped.load(), q.coalesced.load(),
+                q.age_last_ns.load() * 1e-6f,
+                dequeued ? float(double(q.age_total_ns.load()) / dequeued * 1e-6) : 0.f,
+                q.age_max_ns.load() * 1e-6f };
+        }
+
+    private:
+        // Bounded multi-producer, multi-consumer ring: every cell carries a sequence number telling
+        // producers and consumers whose turn it is, so each side only competes for its own position counter
+        struct cell
+        {
+            std::atomic<size_t> sequence;
+            frame f;
+            int64_t enqueued_ns;
+            uint64_t ticket;
+            int slot;
+        };
+
+        // Newest ticket handed out per stream, for coalescing
+        struct stream_slot
+        {
+            std::atomic<int> uid{ -1 };
+            std::atomic<uint64_t> latest{ 0 };
+        };
+
+        struct impl
+        {
+            static const int STREAM_SLOTS = 32;
+
+            impl(size_t capacity, overflow_policy p, bool c)
+                : cells(std::max<size_t>(capacity, 1)), policy(p), coalesce(c)
+            {
+                for (size_t i = 0; i < cells.size(); ++i)
+                    cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+
+            static int64_t now_ns()
+            {
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+            }
+
+            int slot_of(const frame& f)
+            {
+                const int uid = f.get_profile().unique_id();
+                for (int i = 0; i < STREAM_SLOTS; ++i)
+                {
+                    int current = slots[i].uid.load();
+                    if (current == uid) return i;
+                    if (current == -1 && slots[i].uid.compare_exchange_strong(current, uid)) return i;
+                    if (current == uid) return i;
+                }
+                return -1; // More streams than slots, these are not coalesced
+            }
+
+            bool try_push(frame& f, int slot, int64_t now)
+            {
+                auto pos = enqueue_pos.load(std::memory_order_relaxed);
+                cell* c;
+                for (;;)
+                {
+                    c = &cells[pos % cells.size()];
+                    auto seq = c->sequence.load(std::memory_order_acquire);
+                    auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+                    if (diff == 0)
+                    {
+                        if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+                    }
+                    else if (diff < 0)
+                        return false; // Full
+                    else
+                        pos = enqueue_pos.load(std::memory_order_relaxed);
+                }
+                c->f = std::move(f);
+                c->enqueued_ns = now;
+                c->slot = slot;
+                c->ticket = slot >= 0 ? ++slots[slot].latest : 0;
+                c->sequence.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+
+            bool try_pop(frame& f, cell* out)
+            {
+                auto pos = dequeue_pos.load(std::memory_order_relaxed);
+                cell* c;
+                for (;;)
+                {
+                    c = &cells[pos % cells.size()];
+                    auto seq = c->sequence.load(std::memory_order_acquire);
+                    auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+                    if (diff == 0)
+                    {
+                        if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+                    }
+                    else if (diff < 0)
+                        return false; // Empty
+                    else
+                        pos = dequeue_pos.load(std::memory_order_relaxed);
+                }
+                f = std::move(c->f);
+                if (out)
+                {
+                    out->enqueued_ns = c->enqueued_ns;
+                    out->ticket = c->ticket;
+                    out->slot = c->slot;
+                }
+                c->sequence.store(pos + cells.size(), std::memory_order_release);
+                return true;
+            }
+
+            // Consumer side: skips superseded frames and records statistics
+            bool pop(frame& f)
+            {
+                cell info;
+                while (try_pop(f, &info))
+                {
+                    if (info.slot >= 0 && info.ticket < slots[info.slot].latest.load())
+                    {
+                        ++coalesced;
+                        f = frame();
+                        continue;
+                    }
+
+                    const uint64_t age = static_cast<uint64_t>(std::max<int64_t>(now_ns() - info.enqueued_ns, 0));
+                    age_last_ns = age;
+                    age_total_ns += age;
+                    auto max = age_max_ns.load();
+                    while (age > max && !age_max_ns.compare_exchange_weak(max, age)) {}
+                    ++dequeued;
+                    return true;
+                }
+                return false;
+            }
+
+            std::vector<cell> cells;
+            overflow_policy policy;
+            bool coalesce;
+            stream_slot slots[STREAM_SLOTS];
+
+            std::atomic<size_t> enqueue_pos{ 0 };
+            std::atomic<size_t> dequeue_pos{ 0 };
+
+            std::atomic<uint64_t> enqueued{ 0 };
+            std::atomic<uint64_t> dequeued{ 0 };
+            std::atomic<uint64_t> dropped{ 0 };
+            std::atomic<uint64_t> coalesced{ 0 };
+            std::atomic<uint64_t> age_last_ns{ 0 };
+            std::atomic<uint64_t> age_total_ns{ 0 };
+            std::atomic<uint64_t> age_max_ns{ 0 };
+
+            std::atomic<int> waiters{ 0 };
+            std::mutex mutex;
+            std::condition_variable cv;
+        };
+
+        std::shared_ptr<impl> _impl;
+    };
+}
+
+#endif
@@ -0,0 +1,398 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2017 Intel Corporation. All Rights Reserved.
+
+#ifndef LIBREALSENSE_RS2_FUSED_FILTER_HPP
+#define LIBREALSENSE_RS2_FUSED_FILTER_HPP
+
+#include <cmath>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include "rs_processing.hpp"
+#include "rs_sensor.hpp"
+#include "rs_depth_kernels.hpp"
+
+namespace rs2
+{
+    /**
+    * Stage selection and parameters of the recommended depth post-processing chain:
+    * decimation, threshold, depth to disparity, spatial, temporal and disparity back to depth.
+    * Defaults match the defaults of the corresponding SDK processing blocks.
+    */
+    struct depth_chain_settings
+    {
+        bool decimation = true;
+        int decimation_magnitude = 2;
+
+        bool threshold = true;
+        float min_distance = 0.15f;         // meters
+        float max_distance = 4.f;           // meters
+
+        bool disparity = true;
+
+        bool spatial = true;
+        int spatial_iterations = 2;
+        float spatial_alpha = 0.5f;
+        float spatial_delta = 20.f;
+        int spatial_holes_fill = 0;
+
+        bool temporal = true;
+        float temporal_alpha = 0.4f;
+        float temporal_delta = 20.f;
+        int temporal_persistence = 3;
+
+        // Keep the working data in the 16-bit fixed-point domain instead of float (see kernels::DISPARITY16_SCALE).
+        // Halves the memory traffic of the spatial and temporal stages at the cost of the documented quantization
+        bool fixed_point = false;
+
+        /**
+        * Read stage parameters from the SDK processing blocks, so that the fused chain can be driven by the same controls
+        */
+        void read_from(const decimation_filter& dec, const threshold_filter& thr,
+            const spatial_filter& spat, const temporal_filter& temp)
+        {
+            decimation_magnitude = static_cast<int>(dec.get_option(RS2_OPTION_FILTER_MAGNITUDE));
+            min_distance = thr.get_option(RS2_OPTION_MIN_DISTANCE);
+            max_distance = thr.get_option(RS2_OPTION_MAX_DISTANCE);
+            spatial_iterations = static_cast<int>(spat.get_option(RS2_OPTION_FILTER_MAGNITUDE));
+            spatial_alpha = spat.get_option(RS2_OPTION_FILTER_SMOOTH_ALPHA);
+            spatial_delta = spat.get_option(RS2_OPTION_FILTER_SMOOTH_DELTA);
+            spatial_holes_fill = static_cast<int>(spat.get_option(RS2_OPTION_HOLES_FILL));
+            temporal_alpha = temp.get_option(RS2_OPTION_FILTER_SMOOTH_ALPHA);
+            temporal_delta = temp.get_option(RS2_OPTION_FILTER_SMOOTH_DELTA);
+            temporal_persistence = static_cast<int>(temp.get_option(RS2_OPTION_HOLES_FILL));
+        }
+    };
+
+    /**
+    * Runs the enabled stages of the depth post-processing chain over a Z16 image in as few sweeps as the data dependencies allow.
+    * Decimation, threshold, domain conversion and the horizontal spatial pass are applied row by row while
+    * the top-down half of the vertical spatial pass follows one row behind. The bottom-up half runs as a second
+    * sweep, which also carries the next iteration's horizontal pass or, on the last iteration, holes filling,
+    * temporal filtering and the conversion back to depth. The stages follow the SDK filters of the same names, but the output
+    * is not verified to match running the SDK blocks one after the other, and with fixed_point it also carries the
+    * quantization documented at kernels::DISPARITY16_SCALE.
+    * All working memory is kept between frames.
+    * The working data is float, or 16-bit fixed point when depth_chain_settings::fixed_point is set.
+    */
+    class depth_chain_engine
+    {
+    public:
+        /**
+        * Output dimensions for an input of the given size
+        */
+        static void output_size(const depth_chain_settings& s, int width, int height, int& out_width, int& out_height)
+        {
+            const int m = magnitude(s);
+            out_width = width / m;
+            out_height = height / m;
+        }
+
+        /**
+        * Process one frame
+        * \param[in] in         Z16 input, width x height pixels
+        * \param[in] units      Depth units in meters
+        * \param[in] d2d        Depth-disparity conversion numerator for the output resolution, zero if disparity is not applicable
+        * \param[out] out       Z16 output of output_size() pixels
+        */
+        void process(const depth_chain_settings& s, const uint16_t* in, int width, int height, float units, float d2d, uint16_t* out)
+        {
+            if (s.fixed_point)
+                run<uint16_t>(s, in, width, height, units, d2d, out);
+            else
+                run<float>(s, in, width, height, units, d2d, out);
+        }
+
+        /**
+        * Drop the temporal history
+        */
+        void reset()
+        {
+            std::fill(_float.last.begin(), _float.last.end(), 0.f);
+            std::fill(_fixed.last.begin(), _fixed.last.end(), uint16_t(0));
+            std::fill(_history.begin(), _history.end(), uint8_t(0));
+        }
+
+    private:
+        // Per-domain working state
+        template<class T>
+        struct buffers
+        {
+            std::vector<T> work;
+            std::vector<T> carry;
+            std::vector<T> out_row;
+            std::vector<T> last;
+        };
+
+        buffers<float>& state(float) { return _float; }
+        buffers<uint16_t>& state(uint16_t) { return _fixed; }
+
+        static int magnitude(const depth_chain_settings& s)
+        {
+            return s.decimation ? std::max(1, std::min(s.decimation_magnitude, 8)) : 1;
+        }
+
+        template<class T>
+        void run(const depth_chain_settings& s, const uint16_t* in, int width, int height, float units, float d2d, uint16_t* out)
+        {
+            const int m = magnitude(s);
+            int ow, oh;
+            output_size(s, width, height, ow, oh);
+            if (!ow || !oh) return;
+
+            d2d = s.disparity ? d2d : 0.f;
+            prepare<T>(s, ow, oh, d2d);
+
+            // The fixed-point disparity domain is scaled, and so are the deltas
+            const float scale = (std::is_same<T, uint16_t>::value && d2d) ? kernels::DISPARITY16_SCALE : 1.f;
+            const float work_d2d = d2d * scale;
+            const float spatial_delta = s.spatial_delta * scale;
+
+            const bool spatial = s.spatial && s.spatial_iterations > 0;
+            const float min_z = s.min_distance / units;
+            const float max_z = s.max_distance / units;
+
+            auto& b = state(T());
+            auto row = [&](int y) { return b.work.data() + size_t(y) * ow; };
+
+            // First sweep: produce working rows and run everything that only looks at rows above
+            for (int y = 0; y < oh; ++y)
+            {
+                kernels::decimate_row(in + size_t(y) * m * width, width, m, _row16.data());
+                if (s.threshold)
+                    kernels::threshold_row(_row16.data(), ow, min_z, max_z);
+                kernels::to_working_row(_row16.data(), row(y), ow, work_d2d);
+
+                if (spatial)
+                {
+                    kernels::spatial_horizontal_row(row(y), ow, s.spatial_alpha, spatial_delta);
+                    if (y > 0)
+                        kernels::spatial_vertical_step(row(y - 1), row(y), ow, s.spatial_alpha, spatial_delta);
+                }
+                else
+                {
+                    finish_row(s, b, row(y), y, ow, work_d2d, scale, out, false);
+                }
+            }
+
+            if (!spatial) return;
+
+            for (int i = 0; i < s.spatial_iterations; ++i)
+            {
+                const bool last = (i == s.spatial_iterations - 1);
+
+                // The horizontal pass of this iteration ran on the previous bottom-up sweep
+                if (i > 0)
+                {
+                    for (int y = 1; y < oh; ++y)
+                        kernels::spatial_vertical_step(row(y - 1), row(y), ow, s.spatial_alpha, spatial_delta);
+                }
+
+                // Bottom-up sweep. carry keeps the finished value of the row below,
+                // since that row may already hold the next iteration's horizontal pass
+                for (int y = oh - 1; y >= 0; --y)
+                {
+                    if (y < oh - 1)
+                        kernels::spatial_vertical_step(b.carry.data(), row(y), ow, s.spatial_alpha, spatial_delta);
+                    memcpy(b.carry.data(), row(y), ow * sizeof(T));
+
+                    if (last)
+                        finish_row(s, b, row(y), y, ow, work_d2d, scale, out, true);
+                    else
+                        kernels::spatial_horizontal_row(row(y), ow, s.spatial_alpha, spatial_delta);
+                }
+            }
+        }
+
+        template<class T>
+        void prepare(const depth_chain_settings& s, int ow, int oh, float d2d)
+        {
+            auto& b = state(T());
+            const size_t size = size_t(ow) * oh;
+            if (b.work.size() != size || _row16.size() != size_t(ow))
+            {
+                _row16.resize(ow);
+                b.work.resize(size);
+                b.carry.resize(ow);
+                b.out_row.resize(ow);
+                b.last.resize(size);
+                _history.resize(size);
+                reset();
+            }
+            // Temporal history is meaningless once the working domain changes
+            const bool fixed = std::is_same<T, uint16_t>::value;
+            if ((d2d != 0) != _disparity || fixed != _fixed_point)
+            {
+                _disparity = (d2d != 0);
+                _fixed_point = fixed;
+                reset();
+            }
+            if (s.temporal_persistence != _persistence.mode())
+                _persistence = kernels::persistence_table(s.temporal_persistence);
+        }
+
+        template<class T>
+        void finish_row(const depth_chain_settings& s, buffers<T>& b, const T* values, int y, int ow, float d2d, float scale,
+            uint16_t* out, bool spatial)
+        {
+            T* r = b.out_row.data();
+            memcpy(r, values, ow * sizeof(T));
+            if (spatial)
+                kernels::holes_fill_row(r, ow, kernels::spatial_holes_fill_radius(s.spatial_holes_fill));
+            if (s.temporal)
+            {
+                const size_t offset = size_t(y) * ow;
+                kernels::temporal_row(r, b.last.data() + offset, _history.data() + offset, ow,
+                    s.temporal_alpha, s.temporal_delta * scale, _persistence);
+            }
+            kernels::from_working_row(r, out + size_t(y) * ow, ow, d2d);
+        }
+
+        std::vector<uint16_t> _row16;
+        buffers<float> _float;
+        buffers<uint16_t> _fixed;
+        std::vector<uint8_t> _history;
+        kernels::persistence_table _persistence;
+        bool _disparity = false;
+        bool _fixed_point = false;
+    };
+
+    /**
+    * Profile of depth frames produced by a block that reduces their resolution, with the matching intrinsics
+    * and the stereo baseline needed for depth-disparity conversion. Recreated only when the input stream or output size changes.
+    */
+    class depth_output_profile
+    {
+    public:
+        /**
+        * Update for an input frame and output size. Returns true if the profile changed, in which case state tied to the stream should be reset.
+        */
+        bool update(const depth_frame& depth, int ow, int oh)
+        {
+            auto profile = depth.get_profile().as<video_stream_profile>();
+            if (_profile && profile.unique_id() == _source_uid && ow == _intrinsics.width && oh == _intrinsics.height)
+                return false;
+
+            auto intrinsics = profile.get_intrinsics();
+            if (ow == profile.width() && oh == profile.height())
+            {
+                _intrinsics = intrinsics;
+                _profile = profile;
+            }
+            else
+            {
+                _intrinsics = scale_intrinsics(intrinsics, profile.width() / ow);
+                _profile = profile.clone(profile.stream_type(), profile.stream_index(), profile.format(), ow, oh, _intrinsics);
+            }
+
+            // Disparity is only applicable to stereo-based depth sensors
+            _baseline_mm = 0.f;
+            try
+            {
+                if (auto stereo = sensor_from_frame(depth)->as<depth_stereo_sensor>())
+                    _baseline_mm = std::fabs(stereo.get_stereo_baseline());
+            }
+            catch (const error&) {}
+
+            _source_uid = profile.unique_id();
+            return true;
+        }
+
+        const stream_profile& profile() const { return _profile; }
+        const rs2_intrinsics& intrinsics() const { return _intrinsics; }
+
+        /**
+        * Depth-disparity conversion numerator at the given width, zero if disparity is not applicable
+        */
+        float d2d(int width, float units) const
+        {
+            if (_baseline_mm <= 0 || !_intrinsics.width) return 0.f;
+            const float fx = _intrinsics.fx * width / _intrinsics.width;
+            return kernels::DISPARITY_SUBPIXEL * fx * (_baseline_mm * 0.001f) / units;
+        }
+
+    private:
+        stream_profile _profile;
+        rs2_intrinsics _intrinsics{};
+        int _source_uid = -1;
+        float _baseline_mm = 0.f;
+    };
+
+    /**
+    * Replace the Z16 depth frame of a frameset, passing the other frames through
+    */
+    inline frame replace_depth(const frameset& fs, const frame& depth, frame_source& source)
+    {
+        std::vector<frame> frames;
+        for (auto f : fs)
+        {
+            if (f.get_profile().stream_type() == RS2_STREAM_DEPTH && f.get_profile().format() == RS2_FORMAT_Z16)
+                frames.push_back(depth);
+            else
+                frames.push_back(f);
+        }
+        return source.allocate_composite_frame(frames);
+    }
+
+    /**
+    * Single processing block replacing the chain of decimation, threshold, disparity, spatial, temporal and disparity
+    * to depth filters. Each stage of the chain writes a full frame, while this block keeps intermediate results in
+    * reused working memory and allocates only the output frame. Accepts depth frames or framesets; in the latter case
+    * the depth frame is replaced and the rest of the frameset passes through.
+    */
+    class fused_filter_chain : public filter
+    {
+    public:
+        fused_filter_chain(const depth_chain_settings& settings = depth_chain_settings())
+            : filter([this](frame f, frame_source& s) { func(f, s); }), _settings(settings)
+        {}
+
+        void set_settings(const depth_chain_settings& settings)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _settings = settings;
+        }
+
+        depth_chain_settings get_settings() const
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _settings;
+        }
+
+    private:
+        void func(frame data, frame_source& source)
+        {
+            auto fs = data.as<frameset>();
+            depth_frame depth = fs ? fs.get_depth_frame() : data.as<depth_frame>();
+            if (!depth)
+            {
+                source.frame_ready(data);
+                return;
+            }
+
+            auto settings = get_settings();
+            const int width = depth.get_width(), height = depth.get_height();
+            int ow, oh;
+            depth_chain_engine::output_size(settings, width, height, ow, oh);
+            if (_output.update(depth, ow, oh))
+                _engine.reset();
+
+            auto units = depth.get_units();
+            const float d2d = settings.disparity ? _output.d2d(ow, units) : 0.f;
+
+            auto res = source.allocate_video_frame(_output.profile(), depth, 2, ow, oh, ow * 2, RS2_EXTENSION_DEPTH_FRAME);
+            _engine.process(settings, reinterpret_cast<const uint16_t*>(depth.get_data()), width, height, units, d2d,
+                (uint16_t*)res.get_data());
+
+            source.frame_ready(fs ? replace_depth(fs, res, source) : res);
+        }
+
+        mutable std::mutex _mutex;
+        depth_chain_settings _settings;
+        depth_chain_engine _engine;
+        depth_output_profile _output;
+    };
+}
+
+#endif
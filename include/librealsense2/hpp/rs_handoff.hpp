@@ -0,0 +1,226 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2017 Intel Corporation. All Rights Reserved.
+
+#ifndef LIBREALSENSE_RS2_HANDOFF_HPP
+#define LIBREALSENSE_RS2_HANDOFF_HPP
+
+#include <cmath>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <stdexcept>
+#include <chrono>
+#include <thread>
+#include <cstdint>
+#include <algorithm>
+#include <condition_variable>
+#include "rs_frame.hpp"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace rs2
+{
+    /**
+    * Hands the newest frame from a producer (e.g. the pipeline callback) to a consumer thread with the latency of polling
+    * and the CPU cost of waiting. The consumer parks on a condition variable, but wakes up shortly before the next frame is
+    * due and spins until it arrives, so it is already running when the frame is handed over. How early it wakes is adapted
+    * to the interval and jitter observed between frames; when a frame does not arrive within the spin window the consumer
+    * parks again until notified. Only the newest frame is kept: a frame not taken before the next one arrives is dropped.
+    * Like frame_queue, the object is a frame callback and can be passed to pipeline::start.
+    */
+    class frame_handoff
+    {
+    public:
+        struct statistics
+        {
+            uint64_t delivered;     // Frames taken by the consumer
+            uint64_t dropped;       // Frames replaced before the consumer took them
+            uint64_t spun;          // Frames caught while spinning
+            uint64_t parked;        // Frames that had to wake the consumer up
+            float interval_ms;      // Observed interval between frames
+            float spin_window_ms;   // Time the consumer currently spins around each frame at most
+        };
+
+        frame_handoff() : _state(std::make_shared<state>()) {}
+
+        /**
+        * Hand a frame over to the consumer, replacing a frame it did not take yet
+        */
+        void enqueue(frame f) const
+        {
+            auto& s = *_state;
+            const int64_t now = now_ns();
+            {
+                std::lock_guard<std::mutex> lock(s.mutex);
+                if (s.slot) ++s.dropped;
+                s.slot = std::move(f);
+
+                // Smoothed interval and jitter between frames, in nanoseconds
+                if (s.last_arrival)
+                {
+                    const double interval = double(now - s.last_arrival);
+                    const double previous = s.interval.load(std::memory_order_relaxed);
+                    const double mean = previous ? previous + (interval - previous) * SMOOTHING : interval;
+                    s.interval.store(mean, std::memory_order_relaxed);
+                    s.jitter += (std::abs(interval - mean) - s.jitter) * SMOOTHING;
+                    const double min_window = MIN_WINDOW_NS;
+                    s.window.store(std::min(3 * s.jitter + min_window, std::max(min_window, mean / 4)), std::memory_order_relaxed);
+                }
+                s.last_arrival = now;
+                s.next_due.store(now + int64_t(s.interval.load(std::memory_order_relaxed)), std::memory_order_relaxed);
+                s.sequence.fetch_add(1, std::memory_order_release);
+            }
+            if (s.parked.load())
+                s.cv.notify_one();
+        }
+
+        void operator()(frame f) const { enqueue(std::move(f)); }
+
+        /**
+        * Wait up to timeout_ms for the next frame
+        * \return true if a frame was stored to output
+        */
+        template<class T>
+        bool try_wait_for_frame(T* output, unsigned int timeout_ms = 5000) const
+        {
+            auto& s = *_state;
+            const int64_t deadline = now_ns() + int64_t(timeout_ms) * 1000000;
+            std::unique_lock<std::mutex> lock(s.mutex);
+            for (;;)
+            {
+                if (take(s, output)) return true;
+                const int64_t now = now_ns();
+                if (now >= deadline) return false;
+
+                // Sleep until shortly before the next frame is due, then spin. The window is the whole spin per frame,
+                // centered on the time the frame is due; a wakeup inside it resumes the same spin rather than starting another
+                const int64_t window = int64_t(s.window.load(std::memory_order_relaxed));
+                const int64_t due = s.next_due.load(std::memory_order_relaxed);
+                const int64_t spin_start = due - window / 2;
+                const int64_t spin_end = std::min(spin_start + window, deadline);
+                if (s.interval.load(std::memory_order_relaxed) > 0 && spin_start > now)
+                {
+                    wait_until(s, lock, std::min(spin_start, deadline));
+                    continue;
+                }
+                if (now < spin_end)
+                {
+                    const uint64_t seen = s.sequence.load(std::memory_order_acquire);
+                    lock.unlock();
+                    while (s.sequence.load(std::memory_order_acquire) == seen && now_ns() < spin_end)
+                        pause();
+                    lock.lock();
+                    if (take(s, output))
+                    {
+                        ++s.spun;
+                        return true;
+                    }
+                }
+
+                // The frame is late: park until it arrives
+                ++s.parked;
+                s.cv.wait_until(lock, to_time_point(deadline), [&] { return bool(s.slot); });
+                --s.parked;
+                if (take(s, output))
+                {
+                    ++s.parked_hits;
+                    return true;
+                }
+            }
+        }
+
+        frame wait_for_frame(unsigned int timeout_ms = 5000) const
+        {
+            frame f;
+            if (!try_wait_for_frame(&f, timeout_ms))
+                throw std::runtime_error("Frame didn't arrive within " + std::to_string(timeout_ms));
+            return f;
+        }
+
+        template<class T>
+        bool poll_for_frame(T* output) const
+        {
+            std::lock_guard<std::mutex> lock(_state->mutex);
+            return take(*_state, output);
+        }
+
+        statistics get_statistics() const
+        {
+            auto& s = *_state;
+            std::lock_guard<std::mutex> lock(s.mutex);
+            return{ s.delivered, s.dropped, s.spun, s.parked_hits,
+                float(s.interval.load() * 1e-6), float(s.window.load() * 1e-6) };
+        }
+
+    private:
+        static constexpr double SMOOTHING = 0.1;
+        static constexpr double MIN_WINDOW_NS = 50000;  // 50 microseconds
+
+        struct state
+        {
+            std::mutex mutex;
+            std::condition_variable cv;
+            frame slot;
+            std::atomic<uint64_t> sequence{ 0 };
+            std::atomic<int> parked{ 0 };
+
+            // Arrival pattern, written by the producer under the mutex and read by the consumer while spinning
+            int64_t last_arrival = 0;
+            double jitter = 0;
+            std::atomic<double> interval{ 0 };
+            std::atomic<double> window{ MIN_WINDOW_NS };
+            std::atomic<int64_t> next_due{ 0 };
+
+            uint64_t delivered = 0;
+            uint64_t dropped = 0;
+            uint64_t spun = 0;
+            uint64_t parked_hits = 0;
+        };
+
+        template<class T>
+        static bool take(state& s, T* output)
+        {
+            if (!s.slot) return false;
+            *output = T(std::move(s.slot));
+            s.slot = frame();
+            ++s.delivered;
+            return true;
+        }
+
+        static int64_t now_ns()
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        static std::chrono::steady_clock::time_point to_time_point(int64_t ns)
+        {
+            return std::chrono::steady_clock::time_point(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(ns)));
+        }
+
+        static void wait_until(state& s, std::unique_lock<std::mutex>& lock, int64_t ns)
+        {
+            ++s.parked;
+            s.cv.wait_until(lock, to_time_point(ns), [&] { return bool(s.slot); });
+            --s.parked;
+        }
+
+        // Tell the core the thread is spinning, which saves power and frees resources for a hyper-threaded sibling
+        static void pause()
+        {
+#if defined(_MSC_VER)
+            _mm_pause();
+#elif defined(__i386__) || defined(__x86_64__)
+            __builtin_ia32_pause();
+#elif defined(__aarch64__)
+            asm volatile("yield");
+#endif
+        }
+
+        std::shared_ptr<state> _state;
+    };
+}
+
+#endif
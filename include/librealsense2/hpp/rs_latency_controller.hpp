@@ -0,0 +1,181 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2017 Intel Corporation. All Rights Reserved.
+
+#ifndef LIBREALSENSE_RS2_LATENCY_CONTROLLER_HPP
+#define LIBREALSENSE_RS2_LATENCY_CONTROLLER_HPP
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include <functional>
+#include "../rs.hpp"
+#include "rs_filter_timing.hpp"
+
+namespace rs2
+{
+    /**
+    * Keeps the processing time of a filter chain inside a per-frame budget by trading quality for speed at runtime.
+    * The controller sums the measured cost of the instrumented stages and walks a ladder of degradation steps:
+    * when the smoothed cost exceeds the budget the next step is applied. The saving of a step is measured once the cost
+    * settled after applying it, and the step is reverted only when the cost plus that saving stays below the budget by the
+    * hysteresis margin, so that a step saving a large part of the budget is not reverted just to be applied again.
+    * After every change the controller waits for the measurements to settle before acting again. Every change is reported through the SDK log (see rs2::log_to_console).
+    */
+    class latency_budget_controller
+    {
+    public:
+        /**
+        * \param[in] budget_ms      Per-frame processing budget in milliseconds
+        * \param[in] hysteresis     Fraction of the budget the cost, including the saving of the step to revert, must stay below it before quality is restored
+        * \param[in] settle_frames  Frames to wait after a change before the next one
+        */
+        latency_budget_controller(float budget_ms, float hysteresis = 0.25f, int settle_frames = 30)
+            : _budget_ms(budget_ms), _hysteresis(hysteresis), _settle_frames(settle_frames)
+        {}
+
+        /**
+        * Include the cost of an instrumented stage. Stages that did not run since the last update cost nothing.
+        */
+        void add_cost(const instrumented_filter& stage)
+        {
+            _stages.push_back({ &stage, 0.f });
+        }
+
+        /**
+        * Degradation step setting an option of a processing block, e.g. RS2_OPTION_FILTER_MAGNITUDE of decimation_filter
+        * or of spatial_filter (iterations), or RS2_OPTION_HOLES_FILL of spatial_filter. Reverting restores the value found when the step was applied.
+        */
+        void add_option_step(const options& block, rs2_option option, float degraded_value, const std::string& name)
+        {
+            auto previous = std::make_shared<float>(0.f);
+            add_step(name,
+                [=, &block]() {
+                    *previous = block.get_option(option);
+                    block.set_option(option, degraded_value);
+                    return describe(*previous, degraded_value);
+                },
+                [=, &block]() {
+                    block.set_option(option, *previous);
+                    return describe(degraded_value, *previous);
+                });
+        }
+
+        /**
+        * Degradation step turning off an optional stage
+        */
+        void add_stage_toggle(std::atomic_bool& enabled, const std::string& name)
+        {
+            auto previous = std::make_shared<bool>(true);
+            add_step(name,
+                [=, &enabled]() { *previous = enabled.exchange(false); return std::string(*previous ? "on -> off" : "off -> off"); },
+                [=, &enabled]() { enabled = *previous; return std::string(*previous ? "off -> on" : "off -> off"); });
+        }
+
+        /**
+        * Generic degradation step. Both functions return a short description of the change for the log.
+        */
+        void add_step(const std::string& name, std::function<std::string()> degrade, std::function<std::string()> restore)
+        {
+            _steps.push_back({ name, degrade, restore, 0.f, 0.f });
+        }
+
+        /**
+        * Call once per processed frame, from the thread that runs the filters.
+        * The accessors below may be called from any thread.
+        */
+        void update()
+        {
+            float cost = 0.f;
+            for (auto& s : _stages)
+            {
+                auto frames_in = s.timing->get_option(instrumented_filter::OPTION_FRAMES_IN);
+                if (frames_in != s.frames_in)
+                    cost += s.timing->get_option(instrumented_filter::OPTION_PROCESSING_TIME_LAST);
+                s.frames_in = frames_in;
+            }
+            const float previous = _cost_ms;
+            const float smoothed = previous < 0 ? cost : previous + SMOOTHING * (cost - previous);
+            _cost_ms = smoothed;
+
+            if (++_frames_since_change < _settle_frames) return;
+
+            if (_measuring)
+            {
+                auto& step = _steps[_level - 1];
+                step.saving = std::max(0.f, step.cost_before - smoothed);
+                _measuring = false;
+            }
+
+            const float budget = _budget_ms;
+            if (smoothed > budget && _level < _steps.size())
+            {
+                auto& step = _steps[_level];
+                step.cost_before = smoothed;
+                report("over", step.name, step.degrade());
+                ++_level;
+                _measuring = true;
+            }
+            else if (_level > 0 && smoothed + _steps[_level - 1].saving < budget * (1.f - _hysteresis))
+            {
+                auto& step = _steps[_level - 1];
+                report("under", step.name, step.restore());
+                --_level;
+            }
+        }
+
+        float budget() const { return _budget_ms; }
+        void set_budget(float budget_ms) { _budget_ms = budget_ms; }
+        float smoothed_cost() const { return _cost_ms; }
+        size_t level() const { return _level; }
+
+    private:
+        static constexpr float SMOOTHING = 0.1f;
+
+        struct stage
+        {
+            const instrumented_filter* timing;
+            float frames_in;
+        };
+
+        struct step
+        {
+            std::string name;
+            std::function<std::string()> degrade;
+            std::function<std::string()> restore;
+            float cost_before;      // Smoothed cost when the step was last applied
+            float saving;           // Cost removed by the step, measured once settled
+        };
+
+        static std::string describe(float from, float to)
+        {
+            std::stringstream ss;
+            ss << from << " -> " << to;
+            return ss.str();
+        }
+
+        void report(const char* direction, const std::string& name, const std::string& change)
+        {
+            std::stringstream ss;
+            ss << std::fixed << std::setprecision(2) << "Latency budget: cost " << _cost_ms.load() << " ms " << direction
+               << " budget " << _budget_ms.load() << " ms, " << name << " " << change;
+            log(RS2_LOG_SEVERITY_INFO, ss.str().c_str());
+            _frames_since_change = 0;
+        }
+
+        std::atomic<float> _budget_ms;
+        float _hysteresis;
+        int _settle_frames;
+        int _frames_since_change = 0;
+        bool _measuring = false;    // The saving of the latest step is not measured yet
+        std::atomic<float> _cost_ms{ -1.f };
+        std::atomic<size_t> _level{ 0 };
+        std::vector<stage> _stages;
+        std::vector<step> _steps;
+    };
+}
+
+#endif
@@ -0,0 +1,621 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2017 Intel Corporation. All Rights Reserved.
+
+#ifndef LIBREALSENSE_RS2_LZ4_RECORDING_HPP
+#define LIBREALSENSE_RS2_LZ4_RECORDING_HPP
+
+#include <map>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+#include <functional>
+#include <condition_variable>
+#include "../rs.hpp"
+#include "rs_internal.hpp"
+#include "rs_executor.hpp"
+#include "rs_frame_pool.hpp"
+#include "rs_depth_codec.hpp"
+
+// Requires third-party/lz4 on the include path, with lz4.c and lz4hc.c compiled into the application
+#include <lz4.h>
+#include <lz4hc.h>
+
+namespace rs2
+{
+    /**
+    * Layout of the compressed recordings written by lz4_recorder and read by lz4_playback.
+    * After the magic number, the file is a sequence of records. A stream record describes a video stream before its
+    * first frame, including the codec of its frames; a frame record holds the metadata of one frame and its pixels,
+    * compressed unless compression did not make them smaller. Values are stored in the byte order of the recording machine.
+    */
+    namespace lz4_format
+    {
+        static const uint64_t MAGIC = 0x32305A4C53523152ull;   // "R1RSLZ02"
+
+        enum record_kind : uint32_t
+        {
+            STREAM = 1,
+            FRAME = 2
+        };
+
+        enum codec : int32_t
+        {
+            LZ4 = 0,
+            DEPTH = 1               // depth_codec, for Z16 streams
+        };
+
+        struct stream_record
+        {
+            int32_t id;
+            int32_t type;
+            int32_t index;
+            int32_t format;
+            int32_t fps;
+            int32_t bpp;
+            float depth_units;
+            rs2_intrinsics intrinsics;
+            int32_t codec;
+        };
+
+        struct frame_record
+        {
+            int32_t stream;
+            int32_t domain;
+            uint64_t frame_number;
+            double timestamp;
+            uint32_t size;          // Size of the pixels
+            uint32_t stored_size;   // Size in the file, equal to size if stored uncompressed
+        };
+    }
+
+    /**
+    * Records video frames to an LZ4 compressed file, so that the disk has to keep up with a fraction of the raw data rate.
+    * Frames are compressed in parallel on an executor, and a writer thread writes them to disk in the order they arrived.
+    * Z16 depth compresses poorly with LZ4, so depth streams use depth_codec instead, unless told otherwise. Both codecs are lossless.
+    * Frames arriving while more than max_pending frames are waiting for compression or for the disk are dropped and
+    * counted, rather than holding the SDK back. The pixels of accepted frames are copied into buffers of the shared
+    * frame_buffer_pool, so the SDK frames are released when the callback returns and the frame queues of the SDK never
+    * wait for the compression. The pipeline keeps its own copy of the recorder, writing to the same file: keep another
+    * copy to call close on, which finishes the file once the frames already accepted are on disk.
+    */
+    class lz4_recorder
+    {
+    public:
+        struct statistics
+        {
+            uint64_t frames;            // Frames written
+            uint64_t dropped;           // Frames dropped because compression or the disk fell behind
+            uint64_t raw_bytes;         // Size of the pixels of the frames written
+            uint64_t stored_bytes;      // Size of the pixels in the file
+        };
+
+        /**
+        * \param[in] file             Recording to create
+        * \param[in] level            0 for fast LZ4, 1-12 for the stronger and slower LZ4 HC
+        * \param[in] use_depth_codec  Compress Z16 streams with depth_codec rather than LZ4
+        * \param[in] max_pending      Frames compressed or written at a time
+        * \param[in] ex               Executor running the compression
+        */
+        explicit lz4_recorder(const std::string& file, int level = 0, bool use_depth_codec = true, size_t max_pending = 32, executor& ex = executor::instance())
+            : _impl(std::make_shared<impl>(file, level, use_depth_codec, std::max<size_t>(max_pending, 1), ex))
+        {
+            _impl->start();
+        }
+
+        void operator()(frame f) const { _impl->record(f, _impl); }
+
+        /**
+        * Ignore frames until resume is called
+        */
+        void pause() const { _impl->paused = true; }
+        void resume() const { _impl->paused = false; }
+
+        /**
+        * Wait until every accepted frame is on disk and close the file. Later frames are ignored.
+        */
+        void close() const { _impl->close(); }
+
+        statistics get_statistics() const
+        {
+            std::lock_guard<std::mutex> lock(_impl->mutex);
+            return _impl->stats;
+        }
+
+    private:
+        struct chunk
+        {
+            bool ready = false;
+            std::vector<char> bytes;
+            uint64_t raw = 0;
+            uint64_t stored = 0;
+        };
+
+        struct impl
+        {
+            impl(const std::string& file, int l, bool codec, size_t max, executor& e)
+                : out(file, std::ios::binary), level(l), use_depth_codec(codec), max_pending(max), ex(e), depth(32, e)
+            {
+                if (!out) throw std::runtime_error("Failed to create " + file);
+                out.write(reinterpret_cast<const char*>(&lz4_format::MAGIC), sizeof(lz4_format::MAGIC));
+            }
+
+            ~impl() { close(); }
+
+            void start() { writer = std::thread([this]() { write(); }); }
+
+            void record(frame f, const std::shared_ptr<impl>& self)
+            {
+                if (auto fs = f.as<frameset>())
+                {
+                    for (const frame& sub : fs) record(sub, self);
+                    return;
+                }
+                auto vf = f.as<video_frame>();
+                if (!vf || paused) return;
+
+                uint64_t seq;
+                lz4_format::codec codec;
+                lz4_format::frame_record header = {};
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (closed) return;
+                    if (pending.size() >= max_pending)
+                    {
+                        ++stats.dropped;
+                        return;
+                    }
+                    auto profile = vf.get_profile();
+                    auto it = streams.find(profile.unique_id());
+                    if (it == streams.end())
+                    {
+                        it = streams.insert({ profile.unique_id(), int32_t(streams.size()) }).first;
+                        add_stream(vf, it->second);
+                    }
+                    header.stream = it->second;
+                    codec = codecs[size_t(it->second)];
+                    seq = next++;
+                    pending[seq];
+                }
+
+                header.domain = int32_t(vf.get_frame_timestamp_domain());
+                header.frame_number = vf.get_frame_number();
+                header.timestamp = vf.get_timestamp();
+                header.size = uint32_t(vf.get_stride_in_bytes() * vf.get_height());
+
+                // Compress a pooled copy, so that the SDK gets its frame back now rather than after compression
+                auto pixels = frame_buffer_pool::instance().lease<char>(header.size, vf.get_profile().format());
+                memcpy(pixels.get(), vf.get_data(), header.size);
+                const int width = vf.get_width(), height = vf.get_height(), stride = vf.get_stride_in_bytes();
+                ex.submit([self, pixels, width, height, stride, header, seq, codec]() {
+                    self->compress(pixels.get(), width, height, stride, header, seq, codec);
+                });
+            }
+
+            // Called under the mutex. Stream records do not need compression and are ready right away
+            void add_stream(const video_frame& vf, int32_t id)
+            {
+                auto profile = vf.get_profile().as<video_stream_profile>();
+                lz4_format::stream_record s = {};
+                s.id = id;
+                s.type = int32_t(profile.stream_type());
+                s.index = profile.stream_index();
+                s.format = int32_t(profile.format());
+                s.fps = profile.fps();
+                s.bpp = vf.get_bytes_per_pixel();
+                if (auto depth = vf.as<depth_frame>()) s.depth_units = depth.get_units();
+                try { s.intrinsics = profile.get_intrinsics(); }
+                catch (const error&)
+                {
+                    s.intrinsics = {};
+                    s.intrinsics.width = vf.get_width();
+                    s.intrinsics.height = vf.get_height();
+                }
+                s.codec = use_depth_codec && profile.format() == RS2_FORMAT_Z16 ? lz4_format::DEPTH : lz4_format::LZ4;
+                codecs.push_back(lz4_format::codec(s.codec));
+
+                auto& c = pending[next++];
+                c.ready = true;
+                append(c.bytes, lz4_format::STREAM);
+                append(c.bytes, s);
+            }
+
+            void compress(const char* src, int width, int height, int stride, lz4_format::frame_record header, uint64_t seq, lz4_format::codec codec)
+            {
+                const size_t prefix = sizeof(uint32_t) + sizeof(header);
+                std::vector<char> bytes(prefix);
+                int size = 0;
+                if (codec == lz4_format::DEPTH)
+                {
+                    std::vector<uint8_t> encoded;
+                    size = int(depth.encode(reinterpret_cast<const uint16_t*>(src), width, height, stride, encoded));
+                    bytes.insert(bytes.end(), encoded.begin(), encoded.end());
+                }
+                else
+                {
+                    bytes.resize(prefix + size_t(LZ4_compressBound(int(header.size))));
+                    const int capacity = int(bytes.size() - prefix);
+                    size = level > 0
+                        ? LZ4_compress_HC(src, bytes.data() + prefix, int(header.size), capacity, level)
+                        : LZ4_compress_default(src, bytes.data() + prefix, int(header.size), capacity);
+                }
+                if (size <= 0 || uint32_t(size) >= header.size)
+                {
+                    bytes.resize(prefix + header.size);
+                    memcpy(bytes.data() + prefix, src, header.size);
+                    size = int(header.size);
+                }
+                header.stored_size = uint32_t(size);
+                const uint32_t kind = lz4_format::FRAME;
+                memcpy(bytes.data(), &kind, sizeof(kind));
+                memcpy(bytes.data() + sizeof(kind), &header, sizeof(header));
+                bytes.resize(sizeof(kind) + sizeof(header) + size_t(size));
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    auto& c = pending[seq];
+                    c.bytes.swap(bytes);
+                    c.raw = header.size;
+                    c.stored = header.stored_size;
+                    c.ready = true;
+                }
+                cv.notify_all();
+            }
+
+            // Writes the chunks in sequence, each as soon as it and all before it are compressed
+            void write()
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                for (;;)
+                {
+                    cv.wait(lock, [&] { return (!pending.empty() && pending.begin()->second.ready) || (closed && pending.empty()); });
+                    if (pending.empty()) return;
+                    chunk c;
+                    std::swap(c, pending.begin()->second);
+                    pending.erase(pending.begin());
+                    lock.unlock();
+                    out.write(c.bytes.data(), std::streamsize(c.bytes.size()));
+                    lock.lock();
+                    if (c.raw)
+                    {
+                        ++stats.frames;
+                        stats.raw_bytes += c.raw;
+                        stats.stored_bytes += c.stored;
+                    }
+                    cv.notify_all();
+                }
+            }
+
+            void close()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (closed) return;
+                    closed = true;
+                }
+                cv.notify_all();
+                if (writer.joinable()) writer.join();
+                out.close();
+            }
+
+            template<class T>
+            static void append(std::vector<char>& bytes, const T& value)
+            {
+                auto p = reinterpret_cast<const char*>(&value);
+                bytes.insert(bytes.end(), p, p + sizeof(value));
+            }
+
+            std::ofstream out;
+            int level;
+            bool use_depth_codec;
+            size_t max_pending;
+            executor& ex;
+            depth_codec depth;
+            std::thread writer;
+            std::atomic<bool> paused{ false };
+
+            std::mutex mutex;
+            std::condition_variable cv;
+            std::map<uint64_t, chunk> pending;  // By sequence number, written in order
+            std::map<int, int32_t> streams;     // Stream profile unique id to stream record id
+            std::vector<lz4_format::codec> codecs;  // By stream record id
+            uint64_t next = 0;
+            bool closed = false;
+            statistics stats = { 0, 0, 0, 0 };
+        };
+
+        std::shared_ptr<impl> _impl;
+    };
+
+    /**
+    * Plays back a recording of lz4_recorder through a software_device, so its frames look like the frames of a camera:
+    * every recorded stream becomes a sensor of the device, and frames are matched into framesets by the matcher of
+    * the device when the sensors are started with e.g. a syncer. A reader thread reads ahead of the playback while
+    * the frames are decompressed in parallel on an executor, into buffers of the shared frame_buffer_pool.
+    */
+    class lz4_playback
+    {
+    public:
+        /**
+        * \param[in] file        Recording to play
+        * \param[in] real_time   Deliver frames at the pace they were recorded, or as fast as they are decompressed
+        * \param[in] read_ahead  Frames read and decompressed ahead of the playback
+        * \param[in] ex          Executor running the decompression
+        */
+        explicit lz4_playback(const std::string& file, bool real_time = true, size_t read_ahead = 16, executor& ex = executor::instance())
+            : _impl(std::make_shared<impl>(file, real_time, std::max<size_t>(read_ahead, 1), ex))
+        {}
+
+        ~lz4_playback() { stop(); }
+
+        lz4_playback(const lz4_playback&) = delete;
+        lz4_playback& operator=(const lz4_playback&) = delete;
+
+        /**
+        * Device with a sensor per recorded stream
+        */
+        software_device get_device() const { return _impl->dev; }
+
+        /**
+        * Open every recorded stream and start delivering frames to the callback
+        */
+        template<class T>
+        void start(T callback)
+        {
+            stop();
+            for (auto& s : _impl->sensors)
+            {
+                s.second.sensor.open(s.second.profile);
+                s.second.sensor.start(callback);
+            }
+            _impl->stopping = false;
+            _impl->read_all = false;
+            _impl->finished = false;
+            auto state = _impl;
+            _impl->reader = std::thread([state]() { state->read(state); });
+            _impl->player = std::thread([state]() { state->play(); });
+        }
+
+        void stop()
+        {
+            auto& s = *_impl;
+            {
+                std::lock_guard<std::mutex> lock(s.mutex);
+                s.stopping = true;
+            }
+            s.cv.notify_all();
+            if (s.reader.joinable()) s.reader.join();
+            if (s.player.joinable()) s.player.join();
+            // Decompression tasks still running own their results
+            std::lock_guard<std::mutex> lock(s.mutex);
+            for (auto& p : s.queue)
+                if (p->ready && p->pixels) frame_buffer_pool::release(p->pixels);
+            s.queue.clear();
+            for (auto& sensor : s.sensors)
+            {
+                try { sensor.second.sensor.stop(); } catch (const error&) {}
+                try { sensor.second.sensor.close(); } catch (const error&) {}
+            }
+        }
+
+        /**
+        * True once every frame of the recording was delivered
+        */
+        bool finished() const
+        {
+            std::lock_guard<std::mutex> lock(_impl->mutex);
+            return _impl->finished;
+        }
+
+    private:
+        struct stream
+        {
+            software_sensor sensor;
+            stream_profile profile;
+            lz4_format::stream_record record;
+        };
+
+        struct pending_frame
+        {
+            lz4_format::frame_record header;
+            void* pixels = nullptr;
+            bool ready = false;
+            bool abandoned = false;
+        };
+
+        struct impl
+        {
+            impl(const std::string& file, bool rt, size_t ahead, executor& e)
+                : in(file, std::ios::binary), real_time(rt), read_ahead(ahead), ex(e), depth(32, e)
+            {
+                uint64_t magic = 0;
+                if (!read_value(magic) || magic != lz4_format::MAGIC)
+                    throw std::runtime_error(file + " is not an LZ4 recording");
+                data_start = in.tellg();
+
+                // Streams must be known before the sensors start: collect them, skipping the pixels
+                uint32_t kind;
+                while (read_value(kind))
+                {
+                    if (kind == lz4_format::STREAM)
+                    {
+                        lz4_format::stream_record r;
+                        if (!read_value(r)) break;
+                        add_stream(r);
+                    }
+                    else
+                    {
+                        lz4_format::frame_record r;
+                        if (kind != lz4_format::FRAME || !read_value(r)) break;
+                        in.seekg(r.stored_size, std::ios::cur);
+                    }
+                }
+                dev.create_matcher(RS2_MATCHER_DEFAULT);
+            }
+
+            void add_stream(const lz4_format::stream_record& r)
+            {
+                if (sensors.count(r.id)) return;
+                auto sensor = dev.add_sensor(std::string(rs2_stream_to_string(rs2_stream(r.type))) + " " + std::to_string(r.index));
+                auto profile = sensor.add_video_stream({ rs2_stream(r.type), r.index, r.id, r.intrinsics.width, r.intrinsics.height,
+                    r.fps, r.bpp, rs2_format(r.format), r.intrinsics });
+                sensors.insert({ r.id, stream{ sensor, profile, r } });
+            }
+
+            // Reads frames ahead of the player and hands them to the executor for decompression
+            void read(std::shared_ptr<impl> self)
+            {
+                in.clear();
+                in.seekg(data_start);
+                uint32_t kind;
+                while (read_value(kind))
+                {
+                    if (kind == lz4_format::STREAM)
+                    {
+                        lz4_format::stream_record r;
+                        if (!read_value(r)) break;
+                        continue;
+                    }
+                    auto p = std::make_shared<pending_frame>();
+                    if (kind != lz4_format::FRAME || !read_value(p->header)) break;
+                    auto bytes = std::make_shared<std::vector<char>>(p->header.stored_size);
+                    if (!in.read(bytes->data(), std::streamsize(bytes->size()))) break;
+                    auto it = sensors.find(p->header.stream);
+                    if (it == sensors.end()) continue;
+
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        cv.wait(lock, [&] { return stopping || queue.size() < read_ahead; });
+                        if (stopping) return;
+                        queue.push_back(p);
+                    }
+                    const auto record = it->second.record;
+                    ex.submit([self, p, bytes, record]() { self->decompress(*p, *bytes, record); });
+                }
+                std::lock_guard<std::mutex> lock(mutex);
+                read_all = true;
+                cv.notify_all();
+            }
+
+            void decompress(pending_frame& p, const std::vector<char>& bytes, const lz4_format::stream_record& record)
+            {
+                void* pixels = frame_buffer_pool::instance().acquire(p.header.size, rs2_format(record.format));
+                bool ok = true;
+                if (p.header.stored_size == p.header.size)
+                    memcpy(pixels, bytes.data(), bytes.size());
+                else if (record.codec == lz4_format::DEPTH)
+                {
+                    // The image must fit the buffer: decode writes the rows described by the codec header, not header.size
+                    auto data = reinterpret_cast<const uint8_t*>(bytes.data());
+                    const int height = record.intrinsics.height;
+                    const size_t stride = height > 0 ? p.header.size / uint32_t(height) : 0;
+                    int width = 0, encoded_height = 0;
+                    size_t encoded_size = 0;
+                    ok = depth_codec::info(data, bytes.size(), width, encoded_height, encoded_size)
+                        && width == record.intrinsics.width && encoded_height == height && width > 0
+                        && stride >= size_t(width) * sizeof(uint16_t)
+                        && depth.decode(data, bytes.size(), static_cast<uint16_t*>(pixels), int(stride));
+                }
+                else
+                    ok = LZ4_decompress_safe(bytes.data(), static_cast<char*>(pixels), int(bytes.size()), int(p.header.size)) == int(p.header.size);
+
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!ok || p.abandoned)
+                {
+                    frame_buffer_pool::release(pixels);
+                    pixels = nullptr;
+                    if (!ok) log(RS2_LOG_SEVERITY_WARN, "Corrupt frame in LZ4 recording");
+                }
+                p.pixels = pixels;
+                p.ready = true;
+                cv.notify_all();
+            }
+
+            // Delivers the decompressed frames in file order, paced by their timestamps in real-time mode
+            void play()
+            {
+                typedef std::chrono::steady_clock clock;
+                clock::time_point start;
+                double first = 0;
+                bool started = false;
+                std::unique_lock<std::mutex> lock(mutex);
+                for (;;)
+                {
+                    cv.wait(lock, [&] { return stopping || (!queue.empty() && queue.front()->ready) || (read_all && queue.empty()); });
+                    if (stopping)
+                    {
+                        for (auto& p : queue) p->abandoned = true;
+                        return;
+                    }
+                    if (queue.empty())
+                    {
+                        finished = true;
+                        return;
+                    }
+                    auto p = queue.front();
+                    queue.pop_front();
+                    cv.notify_all();
+                    if (!p->pixels) continue;
+
+                    if (real_time)
+                    {
+                        if (!started)
+                        {
+                            started = true;
+                            start = clock::now();
+                            first = p->header.timestamp;
+                        }
+                        auto due = start + std::chrono::microseconds(int64_t((p->header.timestamp - first) * 1000));
+                        if (cv.wait_until(lock, due, [&] { return stopping; }))
+                        {
+                            frame_buffer_pool::release(p->pixels);
+                            continue;
+                        }
+                    }
+                    lock.unlock();
+
+                    auto& s = sensors.at(p->header.stream);
+                    s.sensor.on_video_frame({ p->pixels, frame_buffer_pool::release,
+                        int(p->header.size / uint32_t(std::max(1, s.record.intrinsics.height))), s.record.bpp,
+                        p->header.timestamp, rs2_timestamp_domain(p->header.domain), int(p->header.frame_number),
+                        s.profile, s.record.depth_units });
+                    lock.lock();
+                }
+            }
+
+            template<class T>
+            bool read_value(T& value) { return bool(in.read(reinterpret_cast<char*>(&value), sizeof(value))); }
+
+            std::ifstream in;
+            std::streampos data_start;
+            bool real_time;
+            size_t read_ahead;
+            executor& ex;
+            depth_codec depth;
+            software_device dev;
+            std::map<int32_t, stream> sensors;  // By stream record id
+            std::thread reader;
+            std::thread player;
+
+            std::mutex mutex;
+            std::condition_variable cv;
+            std::deque<std::shared_ptr<pending_frame>> queue;   // Frames in file order, decompressed or not yet
+            bool read_all = false;
+            bool finished = false;
+            bool stopping = false;
+        };
+
+        std::shared_ptr<impl> _impl;
+    };
+}
+
+#endif
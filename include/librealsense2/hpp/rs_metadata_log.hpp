@@ -0,0 +1,287 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2017 Intel Corporation. All Rights Reserved.
+
+#ifndef LIBREALSENSE_RS2_METADATA_LOG_HPP
+#define LIBREALSENSE_RS2_METADATA_LOG_HPP
+
+#include <map>
+#include <mutex>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+#include "../rs.hpp"
+
+namespace rs2
+{
+    /**
+    * Metadata attributes supported by the frames of each stream profile. Which attributes a stream provides does not change
+    * while it streams, so the attributes are looked up once per profile, on its first frame, instead of asking the SDK
+    * about every attribute of every frame. Thread safe.
+    */
+    class metadata_attributes
+    {
+    public:
+        const std::vector<rs2_frame_metadata_value>& of(const frame& f)
+        {
+            const int uid = f.get_profile().unique_id();
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto it = _attributes.find(uid);
+            if (it != _attributes.end()) return it->second;
+
+            auto& list = _attributes[uid];
+            for (int m = 0; m < RS2_FRAME_METADATA_COUNT; ++m)
+                if (f.supports_frame_metadata(rs2_frame_metadata_value(m)))
+                    list.push_back(rs2_frame_metadata_value(m));
+            return list;
+        }
+
+    private:
+        std::mutex _mutex;
+        std::map<int, std::vector<rs2_frame_metadata_value>> _attributes;  // Never erased, so references stay valid
+    };
+
+    /**
+    * Logs the metadata of every frame to a binary file per stream, at a small fraction of the cost of formatting it as text.
+    * A file starts with the list of its columns: frame number, timestamp and the metadata attributes its stream supports.
+    * Every frame appends a fixed-width row of these values, through a buffer written out in large blocks. A value that
+    * was not available for a frame is stored as metadata_log::MISSING. metadata_log::load reads a log back column by
+    * column and metadata_log::to_csv converts it to text.
+    * Frames are logged by calling the object, either directly with the frames an application waits for or as the callback
+    * of pipeline::start. Streams are logged concurrently, each to its own file; the files are complete once the last
+    * copy of the log is destroyed, or after flush.
+    */
+    class metadata_log
+    {
+    public:
+        static const int64_t MISSING = std::numeric_limits<int64_t>::min();
+
+        // Contents of a log file, one vector per column
+        struct table
+        {
+            rs2_stream stream;
+            int index;
+            std::vector<uint64_t> frame_number;
+            std::vector<double> timestamp;
+            std::vector<rs2_frame_metadata_value> attributes;
+            std::vector<std::vector<int64_t>> values;   // One column per attribute
+        };
+
+        /**
+        * \param[in] prefix        Start of the name of the log files, followed by the name and index of the stream and ".rsmeta"
+        * \param[in] buffer_size   Bytes of rows buffered per stream before they are written
+        */
+        explicit metadata_log(const std::string& prefix, size_t buffer_size = 1 << 16)
+            : _impl(std::make_shared<impl>(prefix, buffer_size))
+        {}
+
+        void operator()(frame f) const
+        {
+            if (auto fs = f.as<frameset>())
+            {
+                for (const frame& sub : fs) (*this)(sub);
+                return;
+            }
+            _impl->log(f);
+        }
+
+        /**
+        * Write out the buffered rows
+        */
+        void flush() const
+        {
+            std::lock_guard<std::mutex> lock(_impl->mutex);
+            for (auto& s : _impl->streams) s.second->flush();
+        }
+
+        /**
+        * Names of the files written so far
+        */
+        std::vector<std::string> files() const
+        {
+            std::lock_guard<std::mutex> lock(_impl->mutex);
+            std::vector<std::string> names;
+            for (auto& s : _impl->streams) names.push_back(s.second->name);
+            return names;
+        }
+
+        static std::string file_name(const std::string& prefix, rs2_stream stream, int index)
+        {
+            return prefix + rs2_stream_to_string(stream) + "-" + std::to_string(index) + ".rsmeta";
+        }
+
+        static table load(const std::string& file)
+        {
+            std::ifstream in(file, std::ios::binary);
+            uint64_t magic = 0;
+            int32_t stream = 0, index = 0;
+            uint32_t count = 0;
+            if (!read(in, magic) || magic != MAGIC || !read(in, stream) || !read(in, index) || !read(in, count))
+                throw std::runtime_error(file + " is not a metadata log");
+
+            table t;
+            t.stream = rs2_stream(stream);
+            t.index = index;
+            for (uint32_t c = 0; c < count; ++c)
+            {
+                int32_t attribute = 0;
+                if (!read(in, attribute)) throw std::runtime_error(file + " is truncated");
+                t.attributes.push_back(rs2_frame_metadata_value(attribute));
+            }
+            t.values.resize(count);
+
+            // A row cut short by a crash ends the table
+            std::vector<char> row(row_size(count));
+            while (in.read(row.data(), std::streamsize(row.size())))
+            {
+                const char* p = row.data();
+                uint64_t number;
+                double timestamp;
+                memcpy(&number, p, sizeof(number));
+                memcpy(&timestamp, p + 8, sizeof(timestamp));
+                t.frame_number.push_back(number);
+                t.timestamp.push_back(timestamp);
+                for (uint32_t c = 0; c < count; ++c)
+                {
+                    int64_t value;
+                    memcpy(&value, p + 16 + 8 * c, sizeof(value));
+                    t.values[c].push_back(value);
+                }
+            }
+            return t;
+        }
+
+        /**
+        * Convert a log file to CSV, a row per frame and a column per attribute
+        */
+        static bool to_csv(const std::string& file, const std::string& csv_file)
+        {
+            auto t = load(file);
+            std::ofstream csv(csv_file);
+            csv << "Stream," << rs2_stream_to_string(t.stream) << "," << t.index << "\n";
+            csv << "Frame Number,Timestamp";
+            for (auto a : t.attributes) csv << "," << rs2_frame_metadata_to_string(a);
+            csv << "\n";
+            csv.precision(std::numeric_limits<double>::digits10);
+            for (size_t r = 0; r < t.frame_number.size(); ++r)
+            {
+                csv << t.frame_number[r] << "," << t.timestamp[r];
+                for (auto& column : t.values)
+                {
+                    csv << ",";
+                    if (column[r] != MISSING) csv << column[r];
+                }
+                csv << "\n";
+            }
+            return bool(csv);
+        }
+
+    private:
+        static const uint64_t MAGIC = 0x3141544D53523152ull;   // "R1RSMTA1"
+
+        static size_t row_size(size_t columns) { return 16 + 8 * columns; }
+
+        template<class T>
+        static bool read(std::ifstream& in, T& value) { return bool(in.read(reinterpret_cast<char*>(&value), sizeof(value))); }
+
+        struct stream_file
+        {
+            stream_file(const std::string& n, size_t capacity) : name(n), out(n, std::ios::binary)
+            {
+                if (!out) throw std::runtime_error("Failed to create " + n);
+                buffer.reserve(capacity);
+            }
+
+            ~stream_file() { flush(); }
+
+            template<class T>
+            void append(const T& value)
+            {
+                auto p = reinterpret_cast<const char*>(&value);
+                buffer.insert(buffer.end(), p, p + sizeof(value));
+            }
+
+            void flush()
+            {
+                out.write(buffer.data(), std::streamsize(buffer.size()));
+                out.flush();
+                buffer.clear();
+            }
+
+            std::string name;
+            std::ofstream out;
+            std::vector<char> buffer;
+            std::vector<rs2_frame_metadata_value> columns;
+        };
+
+        struct impl
+        {
+            impl(const std::string& p, size_t size) : prefix(p), buffer_size(std::max<size_t>(size, 1024)) {}
+
+            void log(const frame& f)
+            {
+                auto profile = f.get_profile();
+                const std::pair<int, int> key(profile.stream_type(), profile.stream_index());
+                stream_file* s;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    auto it = streams.find(key);
+                    s = it != streams.end() ? it->second.get() : open(f);
+                }
+
+                // Read the values before taking the lock, so that streams do not wait for each other's metadata.
+                // The columns of a stream are fixed by its first frame; a later profile of the stream may lack some of them
+                const uint64_t number = f.get_frame_number();
+                const double timestamp = f.get_timestamp();
+                int64_t values[RS2_FRAME_METADATA_COUNT];
+                for (size_t c = 0; c < s->columns.size(); ++c)
+                {
+                    rs2_error* e = nullptr;
+                    values[c] = rs2_get_frame_metadata(f.get(), s->columns[c], &e);
+                    if (e)
+                    {
+                        rs2_free_error(e);
+                        values[c] = MISSING;
+                    }
+                }
+
+                std::lock_guard<std::mutex> lock(mutex);
+                s->append(number);
+                s->append(timestamp);
+                s->buffer.insert(s->buffer.end(), reinterpret_cast<const char*>(values), reinterpret_cast<const char*>(values + s->columns.size()));
+                if (s->buffer.size() + row_size(s->columns.size()) > buffer_size) s->flush();
+            }
+
+            // Called under the mutex. Creates the file of a stream and writes its columns
+            stream_file* open(const frame& f)
+            {
+                auto profile = f.get_profile();
+                std::unique_ptr<stream_file> s(new stream_file(file_name(prefix, profile.stream_type(), profile.stream_index()), buffer_size));
+                s->columns = supported.of(f);
+                s->append(uint64_t(MAGIC));
+                s->append(int32_t(profile.stream_type()));
+                s->append(int32_t(profile.stream_index()));
+                s->append(uint32_t(s->columns.size()));
+                for (auto a : s->columns) s->append(int32_t(a));
+                auto& slot = streams[{ profile.stream_type(), profile.stream_index() }];
+                slot = std::move(s);
+                return slot.get();
+            }
+
+            std::string prefix;
+            size_t buffer_size;
+            metadata_attributes supported;
+            std::mutex mutex;
+            std::map<std::pair<int, int>, std::unique_ptr<stream_file>> streams;   // By stream type and index
+        };
+
+        std::shared_ptr<impl> _impl;
+    };
+}
+
+#endif
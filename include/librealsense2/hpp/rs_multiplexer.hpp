@@ -0,0 +1,260 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2017 Intel Corporation. All Rights Reserved.
+
+#ifndef LIBREALSENSE_RS2_MULTIPLEXER_HPP
+#define LIBREALSENSE_RS2_MULTIPLEXER_HPP
+
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <vector>
+#include <memory>
+#include <cmath>
+#include <algorithm>
+#include <condition_variable>
+#include "rs_frame.hpp"
+#include "rs_pipeline.hpp"
+
+namespace rs2
+{
+    /**
+    * Waits on frames of many sources (typically one pipeline per camera) at once.
+    * Sources push frames from their own threads, e.g. from the callback of pipeline::start; the consumer sleeps until
+    * any of them delivers, so waiting costs no CPU. Frames can be consumed as they arrive, or as cross-camera bundles:
+    * one frame per source, all with timestamps within a tolerance of each other. Bundles need timestamps on a shared
+    * clock, which is what RS2_OPTION_GLOBAL_TIME_ENABLED provides (enabled by default on most devices).
+    * Every source keeps at most queue_size frames, older frames are dropped. Frames are only queued for the way of consuming
+    * them that was used last, so a consumer switching between the two starts from the frames arriving after the switch.
+    */
+    class frame_multiplexer
+    {
+    public:
+        /**
+        * \param[in] tolerance_ms   Maximum timestamp difference between the frames of a bundle
+        * \param[in] queue_size     Frames kept per source
+        */
+        explicit frame_multiplexer(double tolerance_ms = 10., size_t queue_size = 8)
+            : _state(std::make_shared<state>(tolerance_ms, std::max<size_t>(queue_size, 1)))
+        {}
+
+        /**
+        * Register a source. Returns the index of the source in bundles.
+        */
+        size_t add_source()
+        {
+            std::lock_guard<std::mutex> lock(_state->mutex);
+            _state->sources.emplace_back();
+            return _state->sources.size() - 1;
+        }
+
+        /**
+        * Deliver a frame or frameset of a source. Safe to call from any thread.
+        */
+        void push(size_t source, frame f)
+        {
+            push(_state, source, std::move(f));
+        }
+
+        /**
+        * Register a pipeline as a new source and start it, delivering its frames to the multiplexer
+        * \return the profile returned by pipeline::start
+        */
+        pipeline_profile start(pipeline& pipe, const config& cfg)
+        {
+            const size_t source = add_source();
+            std::weak_ptr<state> weak = _state;
+            return pipe.start(cfg, [weak, source](frame f) {
+                if (auto s = weak.lock()) push(s, source, std::move(f));
+            });
+        }
+
+        /**
+        * Wait for frames from any source
+        * \param[out] frames    Frames arrived since the last call, from all sources, oldest first
+        * \return false if nothing arrived within the timeout
+        */
+        bool try_wait_for_frames(std::vector<frame>& frames, unsigned int timeout_ms = 5000)
+        {
+            auto& s = *_state;
+            frames.clear();
+            std::unique_lock<std::mutex> lock(s.mutex);
+            s.use(consumer::frames);
+            if (!s.cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), [&] { return s.arrived > 0; }))
+                return false;
+            s.arrived = 0;
+            for (auto& src : s.sources)
+            {
+                frames.insert(frames.end(), src.pending.begin(), src.pending.end());
+                src.pending.clear();
+            }
+            std::sort(frames.begin(), frames.end(), [](const frame& a, const frame& b) { return a.get_timestamp() < b.get_timestamp(); });
+            return !frames.empty();
+        }
+
+        /**
+        * Wait for a bundle: one frame per source, with timestamps within the tolerance of each other
+        * \param[out] bundle    Frame of every source, indexed by source
+        * \return false if no bundle could be formed within the timeout
+        */
+        bool try_wait_for_bundle(std::vector<frame>& bundle, unsigned int timeout_ms = 5000)
+        {
+            auto& s = *_state;
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+            std::unique_lock<std::mutex> lock(s.mutex);
+            s.use(consumer::bundles);
+            for (;;)
+            {
+                if (s.take_bundle(bundle)) return true;
+                s.bundle_ready = false;
+                if (!s.cv.wait_until(lock, deadline, [&] { return s.bundle_ready; }))
+                    return false;
+            }
+        }
+
+        void set_tolerance(double tolerance_ms)
+        {
+            std::lock_guard<std::mutex> lock(_state->mutex);
+            _state->tolerance_ms = tolerance_ms;
+        }
+
+        double get_tolerance() const
+        {
+            std::lock_guard<std::mutex> lock(_state->mutex);
+            return _state->tolerance_ms;
+        }
+
+        /**
+        * Frames dropped because the consumer did not keep up
+        */
+        uint64_t dropped() const
+        {
+            std::lock_guard<std::mutex> lock(_state->mutex);
+            return _state->dropped;
+        }
+
+    private:
+        enum class consumer
+        {
+            none,
+            frames,     // try_wait_for_frames
+            bundles     // try_wait_for_bundle
+        };
+
+        struct source
+        {
+            std::deque<frame> pending;      // For try_wait_for_frames
+            std::deque<frame> history;      // For try_wait_for_bundle
+        };
+
+        // Shared with the callbacks of started pipelines, which may outlive the multiplexer
+        struct state
+        {
+            state(double tolerance, size_t size) : tolerance_ms(tolerance), queue_size(size) {}
+
+            // Called under the mutex. Switching drops the queues of the other way of consuming, which nobody reads
+            void use(consumer c)
+            {
+                if (mode == c) return;
+                mode = c;
+                arrived = 0;
+                for (auto& src : sources)
+                {
+                    if (c != consumer::frames) src.pending.clear();
+                    if (c != consumer::bundles) src.history.clear();
+                    arrived += src.pending.size();
+                }
+            }
+
+            /**
+            * Form a bundle around the oldest of the newest frames of all sources, which is the latest moment every source has reached
+            */
+            bool take_bundle(std::vector<frame>& bundle)
+            {
+                if (sources.empty()) return false;
+                double anchor = 0;
+                for (size_t i = 0; i < sources.size(); ++i)
+                {
+                    if (sources[i].history.empty()) return false;
+                    const double latest = sources[i].history.back().get_timestamp();
+                    anchor = (i == 0) ? latest : std::min(anchor, latest);
+                }
+
+                std::vector<size_t> picks(sources.size());
+                double min_ts = anchor, max_ts = anchor;
+                for (size_t i = 0; i < sources.size(); ++i)
+                {
+                    auto& h = sources[i].history;
+                    size_t best = 0;
+                    for (size_t j = 1; j < h.size(); ++j)
+                        if (std::fabs(h[j].get_timestamp() - anchor) < std::fabs(h[best].get_timestamp() - anchor)) best = j;
+                    picks[i] = best;
+                    min_ts = std::min(min_ts, h[best].get_timestamp());
+                    max_ts = std::max(max_ts, h[best].get_timestamp());
+                }
+
+                if (max_ts - min_ts > tolerance_ms)
+                {
+                    // Frames older than the anchor by more than the tolerance can never be part of a bundle
+                    for (auto& src : sources)
+                        while (src.history.size() > 1 && src.history.front().get_timestamp() < anchor - tolerance_ms)
+                            src.history.pop_front();
+                    return false;
+                }
+
+                bundle.resize(sources.size());
+                for (size_t i = 0; i < sources.size(); ++i)
+                {
+                    auto& h = sources[i].history;
+                    bundle[i] = h[picks[i]];
+                    h.erase(h.begin(), h.begin() + picks[i] + 1);
+                }
+                return true;
+            }
+
+            std::mutex mutex;
+            std::condition_variable cv;
+            std::vector<source> sources;
+            double tolerance_ms;
+            size_t queue_size;
+            size_t arrived = 0;
+            bool bundle_ready = false;
+            uint64_t dropped = 0;
+            consumer mode = consumer::none;     // Until the first wait, frames are queued for both
+        };
+
+        static void push(const std::shared_ptr<state>& s, size_t index, frame f)
+        {
+            {
+                std::lock_guard<std::mutex> lock(s->mutex);
+                if (index >= s->sources.size()) return;
+                auto& src = s->sources[index];
+                // Frames are only counted as dropped from the queue of the consumer in use
+                if (s->mode != consumer::bundles)
+                {
+                    src.pending.push_back(f);
+                    if (src.pending.size() > s->queue_size)
+                    {
+                        src.pending.pop_front();
+                        if (s->mode == consumer::frames) ++s->dropped;
+                    }
+                }
+                if (s->mode != consumer::frames)
+                {
+                    src.history.push_back(f);
+                    if (src.history.size() > s->queue_size)
+                    {
+                        src.history.pop_front();
+                        if (s->mode == consumer::bundles) ++s->dropped;
+                    }
+                }
+                ++s->arrived;
+                s->bundle_ready = true;
+            }
+            s->cv.notify_all();
+        }
+
+        std::shared_ptr<state> _state;
+    };
+}
+
+#endif
@@ -0,0 +1,201 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2017 Intel Corporation. All Rights Reserved.
+
+#ifndef LIBREALSENSE_RS2_PLATFORM_HPP
+#define LIBREALSENSE_RS2_PLATFORM_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace rs2
+{
+    /**
+    * Operating system calls of the header-only helpers. Implementation detail, not part of the API.
+    * On Windows the functions that need <windows.h> are defined out of line in samples/rs-platform.cpp, which has to be
+    * compiled into the application (as the samples using these helpers do), so that <windows.h> and the macros it is
+    * configured with never leak through the SDK headers.
+    */
+    namespace platform
+    {
+#ifdef _WIN32
+        bool set_thread_affinity(const std::vector<int>& cpus);
+        bool set_thread_realtime(int priority);         // Time-critical priority, whatever the value
+        bool set_thread_name(const std::string& name);  // Needs Windows 10 1607
+        size_t page_size();
+#else
+        // Restrict the calling thread to the given CPUs
+        inline bool set_thread_affinity(const std::vector<int>& cpus)
+        {
+#ifdef __linux__
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (int cpu : cpus)
+                if (cpu >= 0 && cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+            return CPU_COUNT(&set) && pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+            (void)cpus;
+            return false;
+#endif
+        }
+
+        // Run the calling thread at real-time priority: SCHED_FIFO with the given priority
+        inline bool set_thread_realtime(int priority)
+        {
+            sched_param param = {};
+            param.sched_priority = std::max(sched_get_priority_min(SCHED_FIFO), std::min(priority, sched_get_priority_max(SCHED_FIFO)));
+            return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+        }
+
+        // Name the calling thread for debuggers and profilers
+        inline bool set_thread_name(const std::string& name)
+        {
+#if defined(__APPLE__)
+            return pthread_setname_np(name.substr(0, 63).c_str()) == 0;
+#elif defined(__linux__)
+            return pthread_setname_np(pthread_self(), name.substr(0, 15).c_str()) == 0;
+#else
+            (void)name;
+            return false;
+#endif
+        }
+
+        inline size_t page_size()
+        {
+            const long size = sysconf(_SC_PAGESIZE);
+            return size > 0 ? size_t(size) : 4096;
+        }
+#endif
+
+        // Names of the files (not directories) in a directory ending with the extension, unsorted
+        inline std::vector<std::string> list_files(const std::string& directory, const std::string& extension)
+        {
+            std::vector<std::string> names;
+#ifdef _WIN32
+            _finddata_t data;
+            intptr_t h = _findfirst((directory + "\\*" + extension).c_str(), &data);
+            if (h != -1)
+            {
+                do
+                {
+                    if (!(data.attrib & _A_SUBDIR)) names.push_back(data.name);
+                } while (_findnext(h, &data) == 0);
+                _findclose(h);
+            }
+#else
+            if (DIR* dir = opendir(directory.c_str()))
+            {
+                while (dirent* entry = readdir(dir))
+                {
+                    std::string name = entry->d_name;
+                    if (name.size() <= extension.size() || name.compare(name.size() - extension.size(), extension.size(), extension) != 0)
+                        continue;
+                    // Not every file system reports the type of the entry
+                    bool is_dir = entry->d_type == DT_DIR;
+                    struct stat st;
+                    if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK)
+                        is_dir = stat((directory + "/" + name).c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+                    if (!is_dir) names.push_back(name);
+                }
+                closedir(dir);
+            }
+#endif
+            return names;
+        }
+
+        /**
+        * A whole file mapped into memory, shared with the file.
+        * A writable file is created with its size, its blocks allocated on disk up front and every page of the mapping touched,
+        * so that writing through the mapping later never faults on a missing page nor fails on a full disk (which with a
+        * sparse file would only show as SIGBUS on a page fault during capture). Creation throws if the space is not available.
+        */
+        class mapped_file
+        {
+        public:
+            mapped_file() = default;
+            mapped_file(const mapped_file&) = delete;
+            mapped_file& operator=(const mapped_file&) = delete;
+
+            ~mapped_file();
+
+            /**
+            * \param[in] path         File to map
+            * \param[in] create_size  Size of the file to create, replacing an existing one, if writable
+            * \param[in] writable     Create the file and map it for writing, otherwise map an existing file for reading
+            */
+            void map(const std::string& path, uint64_t create_size, bool writable);
+
+            void* data() const { return _view; }
+            uint64_t size() const { return _size; }
+
+        private:
+            // Fault every page in now rather than on the first write of each
+            void touch_pages()
+            {
+                const size_t page = page_size();
+                for (uint64_t offset = 0; offset < _size; offset += page)
+                    static_cast<volatile char*>(_view)[offset] = 0;
+            }
+
+#ifdef _WIN32
+            void* _file = nullptr;
+            void* _mapping = nullptr;
+#else
+            int _fd = -1;
+#endif
+            void* _view = nullptr;
+            uint64_t _size = 0;
+        };
+
+#ifndef _WIN32
+        inline mapped_file::~mapped_file()
+        {
+            if (_view) munmap(_view, size_t(_size));
+            if (_fd >= 0) ::close(_fd);
+        }
+
+        inline void mapped_file::map(const std::string& path, uint64_t create_size, bool writable)
+        {
+            _fd = ::open(path.c_str(), writable ? O_RDWR | O_CREAT | O_TRUNC : O_RDONLY, 0644);
+            if (_fd < 0) throw std::runtime_error("Failed to open " + path);
+            if (writable)
+            {
+#ifdef __APPLE__
+                fstore_t store = { F_ALLOCATEALL, F_PEOFPOSMODE, 0, off_t(create_size), 0 };
+                const bool allocated = fcntl(_fd, F_PREALLOCATE, &store) != -1 && ftruncate(_fd, off_t(create_size)) == 0;
+#else
+                const bool allocated = posix_fallocate(_fd, 0, off_t(create_size)) == 0;
+#endif
+                if (!allocated) throw std::runtime_error("Not enough space to allocate " + path);
+                _size = create_size;
+            }
+            else
+            {
+                struct stat st;
+                _size = fstat(_fd, &st) == 0 ? uint64_t(st.st_size) : 0;
+            }
+            if (!_size) throw std::runtime_error("Failed to map empty file " + path);
+            void* p = mmap(nullptr, size_t(_size), writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, _fd, 0);
+            if (p == MAP_FAILED) throw std::runtime_error("Failed to map " + path);
+            _view = p;
+            if (writable) touch_pages();
+        }
+#endif
+    }
+}
+
+#endif
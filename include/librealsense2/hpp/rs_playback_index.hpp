@@ -0,0 +1,384 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2017 Intel Corporation. All Rights Reserved.
+
+#ifndef LIBREALSENSE_RS2_PLAYBACK_INDEX_HPP
+#define LIBREALSENSE_RS2_PLAYBACK_INDEX_HPP
+
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <fstream>
+#include <utility>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+#include "../rs.hpp"
+
+namespace rs2
+{
+    /**
+    * Index of the frames in a recording, kept next to it in a sidecar file (the name of the recording with ".idx" appended).
+    * For every stream it lists the frame number, timestamp and playback position (as reported by playback::get_position)
+    * of each frame, so that a requested position can be snapped to the frame nearest to it without reading the file.
+    * The index does not make playback::seek itself any faster; it makes seeks land on recorded frames.
+    * It is built by a single non-real-time pass over the file the first time the recording is opened.
+    */
+    class playback_index
+    {
+    public:
+        struct entry
+        {
+            uint64_t frame_number;
+            double timestamp;       // Milliseconds
+            int64_t offset;         // Nanoseconds from the start of the recording
+        };
+
+        static std::string sidecar_path(const std::string& file) { return file + ".idx"; }
+
+        /**
+        * Add a frame, or every frame of a frameset, at the given playback position
+        */
+        void add(const frame& f, std::chrono::nanoseconds offset)
+        {
+            if (auto fs = f.as<frameset>())
+            {
+                for (const frame& sub : fs) add(sub, offset);
+                return;
+            }
+            auto profile = f.get_profile();
+            _streams[{ profile.stream_type(), profile.stream_index() }].push_back({ f.get_frame_number(), f.get_timestamp(), offset.count() });
+            _dirty = true;
+        }
+
+        /**
+        * Frames of one stream, ordered by position
+        */
+        const std::vector<entry>& frames(rs2_stream stream, int index = 0) const
+        {
+            static const std::vector<entry> none;
+            auto it = _streams.find({ stream, index });
+            return it == _streams.end() ? none : it->second;
+        }
+
+        bool empty() const { return _streams.empty(); }
+
+        /**
+        * Position of the frame nearest to the given position, of any stream
+        */
+        std::chrono::nanoseconds nearest(std::chrono::nanoseconds position)
+        {
+            prepare();
+            if (_offsets.empty()) return position;
+            const int64_t p = position.count();
+            size_t bucket = size_t(std::max<int64_t>(0, p - _offsets.front()) / _bucket_size);
+            size_t i = _buckets[std::min(bucket, _buckets.size() - 1)];
+            // A bucket spans about one frame, so the scan is short
+            while (i + 1 < _offsets.size() && _offsets[i + 1] <= p) ++i;
+            if (i + 1 < _offsets.size() && _offsets[i + 1] - p < p - _offsets[i]) ++i;
+            return std::chrono::nanoseconds(_offsets[i]);
+        }
+
+        bool save(const std::string& path, uint64_t file_size)
+        {
+            std::ofstream out(path, std::ios::binary);
+            if (!out) return false;
+            write(out, MAGIC);
+            write(out, file_size);
+            write(out, uint32_t(_streams.size()));
+            for (auto& s : _streams)
+            {
+                write(out, int32_t(s.first.first));
+                write(out, int32_t(s.first.second));
+                write(out, uint64_t(s.second.size()));
+                for (auto& e : s.second)
+                {
+                    write(out, e.frame_number);
+                    write(out, e.timestamp);
+                    write(out, e.offset);
+                }
+            }
+            return bool(out);
+        }
+
+        /**
+        * Load an index, rejecting it if it was built for a file of a different size
+        */
+        bool load(const std::string& path, uint64_t file_size)
+        {
+            std::ifstream in(path, std::ios::binary);
+            uint64_t magic = 0, size = 0;
+            uint32_t count = 0;
+            if (!read(in, magic) || magic != MAGIC || !read(in, size) || size != file_size || !read(in, count))
+                return false;
+
+            std::map<std::pair<rs2_stream, int>, std::vector<entry>> streams;
+            for (uint32_t s = 0; s < count; ++s)
+            {
+                int32_t type = 0, index = 0;
+                uint64_t frames = 0;
+                if (!read(in, type) || !read(in, index) || !read(in, frames)) return false;
+                auto& list = streams[{ rs2_stream(type), index }];
+                list.resize(size_t(frames));
+                for (auto& e : list)
+                    if (!read(in, e.frame_number) || !read(in, e.timestamp) || !read(in, e.offset)) return false;
+            }
+            _streams.swap(streams);
+            _dirty = true;
+            return true;
+        }
+
+        /**
+        * Sort the positions of all frames and bucket them, so that nearest finds its bucket by division.
+        * nearest prepares a changed index itself; call it beforehand to keep that work off the thread that seeks
+        */
+        void prepare()
+        {
+            if (!_dirty) return;
+            _dirty = false;
+            _offsets.clear();
+            for (auto& s : _streams)
+            {
+                std::stable_sort(s.second.begin(), s.second.end(), [](const entry& a, const entry& b) { return a.offset < b.offset; });
+                for (auto& e : s.second) _offsets.push_back(e.offset);
+            }
+            std::sort(_offsets.begin(), _offsets.end());
+            _buckets.clear();
+            if (_offsets.empty()) return;
+
+            const int64_t span = _offsets.back() - _offsets.front();
+            _bucket_size = std::max<int64_t>(1, span / int64_t(_offsets.size()));
+            _buckets.resize(size_t(span / _bucket_size) + 1);
+            size_t i = 0;
+            for (size_t b = 0; b < _buckets.size(); ++b)
+            {
+                const int64_t start = _offsets.front() + int64_t(b) * _bucket_size;
+                while (i + 1 < _offsets.size() && _offsets[i + 1] <= start) ++i;
+                _buckets[b] = i;
+            }
+        }
+
+        /**
+        * Index a recording by playing it back once, as fast as possible
+        * \param[in] cancelled  Polled while indexing, returning true stops early with a partial index
+        */
+        static playback_index build(const std::string& file, const std::function<bool()>& cancelled = nullptr)
+        {
+            struct state
+            {
+                std::mutex mutex;
+                std::condition_variable cv;
+                playback_index index;
+                std::unique_ptr<playback> dev;
+                bool done = false;
+            };
+            auto s = std::make_shared<state>();
+
+            context ctx;
+            playback dev = ctx.load_device(file);
+            dev.set_real_time(false);
+            s->dev.reset(new playback(dev));
+            dev.set_status_changed_callback([s](rs2_playback_status status) {
+                if (status != RS2_PLAYBACK_STATUS_STOPPED) return;
+                std::lock_guard<std::mutex> lock(s->mutex);
+                s->done = true;
+                s->cv.notify_all();
+            });
+
+            std::vector<sensor> sensors;
+            for (auto&& sen : dev.query_sensors())
+            {
+                auto profiles = sen.get_stream_profiles();
+                if (profiles.empty()) continue;
+                sen.open(profiles);
+                sensors.push_back(sen);
+            }
+            for (auto& sen : sensors)
+                sen.start([s](frame f) {
+                    // Without real-time pacing, the position follows the frames being read
+                    auto position = std::chrono::nanoseconds(s->dev->get_position());
+                    std::lock_guard<std::mutex> lock(s->mutex);
+                    s->index.add(f, position);
+                });
+
+            std::unique_lock<std::mutex> lock(s->mutex);
+            while (!s->done && !(cancelled && cancelled()))
+                s->cv.wait_for(lock, std::chrono::milliseconds(100));
+            lock.unlock();
+            for (auto& sen : sensors)
+            {
+                try { sen.stop(); } catch (const error&) {}
+                try { sen.close(); } catch (const error&) {}
+            }
+            s->dev.reset();
+            ctx.unload_device(file);
+
+            std::lock_guard<std::mutex> guard(s->mutex);
+            return std::move(s->index);
+        }
+
+        /**
+        * Load the sidecar of a recording, building and saving it if it is missing or out of date.
+        * Building reads the whole file, so call it off the UI thread, as playback_scrubber does.
+        */
+        static playback_index open(const std::string& file, const std::function<bool()>& cancelled = nullptr)
+        {
+            const uint64_t size = size_of(file);
+            playback_index index;
+            if (index.load(sidecar_path(file), size)) return index;
+            index = build(file, cancelled);
+            if (!(cancelled && cancelled())) index.save(sidecar_path(file), size);
+            return index;
+        }
+
+        static uint64_t size_of(const std::string& file)
+        {
+            std::ifstream in(file, std::ios::binary | std::ios::ate);
+            return in ? uint64_t(in.tellg()) : 0;
+        }
+
+    private:
+        static const uint64_t MAGIC = 0x3130584449535231ull;   // "1RSIDX01"
+
+        template<class T>
+        static void write(std::ofstream& out, T value) { out.write(reinterpret_cast<const char*>(&value), sizeof(value)); }
+
+        template<class T>
+        static bool read(std::ifstream& in, T& value) { return bool(in.read(reinterpret_cast<char*>(&value), sizeof(value))); }
+
+        std::map<std::pair<rs2_stream, int>, std::vector<entry>> _streams;
+        std::vector<int64_t> _offsets;      // Positions of all frames, sorted
+        std::vector<size_t> _buckets;       // Last frame at or before the start of every bucket
+        int64_t _bucket_size = 1;
+        bool _dirty = false;
+    };
+
+    /**
+    * Seeks a playback on a background thread, so that dragging a seek bar never waits for the file.
+    * While a seek is in progress only the latest requested position is kept; the positions in between are skipped.
+    * The index of the recording is loaded, or built on its first use, on another background thread; once it is
+    * available, requests are snapped to the nearest indexed frame, until then they go to the requested position.
+    */
+    class playback_scrubber
+    {
+    public:
+        /**
+        * \param[in] dev   Playback to seek
+        * \param[in] file  Recording played by dev, whose index is opened with playback_index::open
+        */
+        playback_scrubber(playback dev, const std::string& file)
+            : _state(std::make_shared<state>(dev))
+        {
+            auto s = _state;
+            _state->worker = std::thread([s]() { s->run(); });
+            _state->indexer = std::thread([s, file]() { s->load_index(file); });
+        }
+
+        ~playback_scrubber()
+        {
+            {
+                std::lock_guard<std::mutex> lock(_state->mutex);
+                _state->stopping = true;
+            }
+            _state->cv.notify_one();
+            _state->worker.join();
+            _state->indexer.join();
+        }
+
+        playback_scrubber(const playback_scrubber&) = delete;
+        playback_scrubber& operator=(const playback_scrubber&) = delete;
+
+        void seek(std::chrono::nanoseconds position)
+        {
+            {
+                std::lock_guard<std::mutex> lock(_state->mutex);
+                _state->target = _state->indexed ? _state->index.nearest(position) : position;
+                _state->pending = true;
+                _state->displayed = _state->target;
+            }
+            _state->cv.notify_one();
+        }
+
+        /**
+        * Position to display: the latest requested one until the playback got there, then the playback position
+        */
+        std::chrono::nanoseconds position() const
+        {
+            std::lock_guard<std::mutex> lock(_state->mutex);
+            if (_state->pending || _state->seeking) return _state->displayed;
+            return std::chrono::nanoseconds(_state->dev.get_position());
+        }
+
+    private:
+        struct state
+        {
+            explicit state(playback d) : dev(d) {}
+
+            void load_index(const std::string& file)
+            {
+                auto cancelled = [this]() {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    return stopping;
+                };
+                playback_index loaded;
+                try
+                {
+                    loaded = playback_index::open(file, cancelled);
+                    loaded.prepare();
+                }
+                catch (const std::exception& e)
+                {
+                    log(RS2_LOG_SEVERITY_WARN, e.what());
+                    return;
+                }
+                catch (...)
+                {
+                    log(RS2_LOG_SEVERITY_WARN, "Unknown exception while indexing the recording");
+                    return;
+                }
+                std::lock_guard<std::mutex> lock(mutex);
+                index = std::move(loaded);
+                indexed = true;
+            }
+
+            void run()
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                for (;;)
+                {
+                    cv.wait(lock, [&] { return stopping || pending; });
+                    if (stopping) return;
+                    auto position = target;
+                    pending = false;
+                    seeking = true;
+                    lock.unlock();
+                    try { dev.seek(position); }
+                    catch (const error& e) { log(RS2_LOG_SEVERITY_WARN, e.what()); }
+                    lock.lock();
+                    seeking = false;
+                }
+            }
+
+            playback dev;
+            playback_index index;
+            mutable std::mutex mutex;
+            std::condition_variable cv;
+            std::thread worker;
+            std::thread indexer;
+            std::chrono::nanoseconds target{ 0 };
+            std::chrono::nanoseconds displayed{ 0 };
+            bool pending = false;
+            bool seeking = false;
+            bool stopping = false;
+            bool indexed = false;       // Once the indexer is done
+        };
+
+        std::shared_ptr<state> _state;
+    };
+}
+
+#endif
@@ -0,0 +1,337 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2017 Intel Corporation. All Rights Reserved.
+
+#ifndef LIBREALSENSE_RS2_ROI_FILTER_HPP
+#define LIBREALSENSE_RS2_ROI_FILTER_HPP
+
+#include <map>
+#include <mutex>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include "rs_types.hpp"
+#include "rs_processing.hpp"
+#include "rs_depth_kernels.hpp"
+
+namespace rs2
+{
+    namespace roi
+    {
+        /**
+        * Thread-safe list of regions of interest, in pixels of the filtered frame. max_x and max_y are inclusive.
+        */
+        class region_list
+        {
+        public:
+            void set(const std::vector<region_of_interest>& regions)
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _regions = regions;
+            }
+
+            std::vector<region_of_interest> get() const
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                return _regions;
+            }
+
+        private:
+            mutable std::mutex _mutex;
+            std::vector<region_of_interest> _regions;
+        };
+
+        /**
+        * Clip a region, grown by margin pixels on every side, to a frame. Returns false if nothing is left.
+        */
+        inline bool clip(const region_of_interest& r, int margin, int width, int height, region_of_interest& out)
+        {
+            out.min_x = std::max(0, std::min(r.min_x, r.max_x) - margin);
+            out.min_y = std::max(0, std::min(r.min_y, r.max_y) - margin);
+            out.max_x = std::min(width - 1, std::max(r.min_x, r.max_x) + margin);
+            out.max_y = std::min(height - 1, std::max(r.min_y, r.max_y) + margin);
+            return out.min_x <= out.max_x && out.min_y <= out.max_y;
+        }
+
+        /**
+        * Copy of the input frame that the filters write their regions into. Pixels outside the regions pass through unchanged.
+        * Supports Z16 depth and 32-bit float disparity, the two formats the spatial and temporal filters run on.
+        */
+        inline frame copy_frame(const video_frame& f, frame_source& source)
+        {
+            const bool disparity = f.get_profile().format() == RS2_FORMAT_DISPARITY32;
+            auto res = source.allocate_video_frame(f.get_profile(), f, f.get_bytes_per_pixel(), f.get_width(), f.get_height(),
+                f.get_stride_in_bytes(), disparity ? RS2_EXTENSION_DISPARITY_FRAME : RS2_EXTENSION_DEPTH_FRAME);
+            memcpy((void*)res.get_data(), f.get_data(), size_t(f.get_stride_in_bytes()) * f.get_height());
+            return res;
+        }
+
+        inline bool is_supported(const video_frame& f)
+        {
+            auto format = f.get_profile().format();
+            return format == RS2_FORMAT_Z16 || format == RS2_FORMAT_DISPARITY32;
+        }
+
+        /**
+        * Read one row segment of a Z16 or float frame into the float working domain
+        */
+        inline void load_segment(const video_frame& f, int x, int y, int count, float* out)
+        {
+            auto row = static_cast<const uint8_t*>(f.get_data()) + size_t(y) * f.get_stride_in_bytes();
+            if (f.get_profile().format() == RS2_FORMAT_DISPARITY32)
+                memcpy(out, reinterpret_cast<const float*>(row) + x, count * sizeof(float));
+            else
+                kernels::to_working_row(reinterpret_cast<const uint16_t*>(row) + x, out, count, 0.f);
+        }
+
+        /**
+        * Write one row segment of the float working domain into a Z16 or float frame
+        */
+        inline void store_segment(const float* in, int x, int y, int count, video_frame& f)
+        {
+            auto row = (uint8_t*)f.get_data() + size_t(y) * f.get_stride_in_bytes();
+            if (f.get_profile().format() == RS2_FORMAT_DISPARITY32)
+                memcpy(reinterpret_cast<float*>(row) + x, in, count * sizeof(float));
+            else
+                kernels::from_working_row(in, reinterpret_cast<uint16_t*>(row) + x, count, 0.f);
+        }
+    }
+
+    /**
+    * Edge-preserving spatial filter restricted to regions of interest (e.g. tracked objects or detection boxes).
+    * Each region is filtered together with a halo of surrounding pixels, so that the recursive passes see the same
+    * neighbourhood they would see on the full frame; only the region itself is written back. Pixels outside all regions
+    * pass through untouched, so the cost scales with the tracked area rather than with the frame.
+    * Options match spatial_filter; with no regions set the frame passes through unfiltered.
+    * Overlapping regions are filtered independently and the one set last wins where they overlap.
+    */
+    class roi_spatial_filter : public filter
+    {
+    public:
+        static const auto OPTION_ROI_HALO = rs2_option(RS2_OPTION_COUNT + 40);
+
+        roi_spatial_filter() : filter([this](frame f, frame_source& s) { func(f, s); })
+        {
+            register_simple_option(RS2_OPTION_FILTER_MAGNITUDE, option_range{ 1, 5, 2, 1 });
+            register_simple_option(RS2_OPTION_FILTER_SMOOTH_ALPHA, option_range{ 0.25f, 1.f, 0.5f, 0.01f });
+            register_simple_option(RS2_OPTION_FILTER_SMOOTH_DELTA, option_range{ 1, 50, 20, 1 });
+            register_simple_option(RS2_OPTION_HOLES_FILL, option_range{ 0, 5, 0, 1 });
+            register_simple_option(OPTION_ROI_HALO, option_range{ 0, 64, 8, 1 });
+        }
+
+        void set_regions(const std::vector<region_of_interest>& regions) { _regions.set(regions); }
+        std::vector<region_of_interest> get_regions() const { return _regions.get(); }
+
+    private:
+        void func(frame data, frame_source& source)
+        {
+            auto f = data.as<video_frame>();
+            auto regions = _regions.get();
+            if (!f || !roi::is_supported(f) || regions.empty())
+            {
+                source.frame_ready(data);
+                return;
+            }
+
+            const int iterations = static_cast<int>(get_option(RS2_OPTION_FILTER_MAGNITUDE));
+            const float alpha = get_option(RS2_OPTION_FILTER_SMOOTH_ALPHA);
+            const float delta = get_option(RS2_OPTION_FILTER_SMOOTH_DELTA);
+            const int radius = kernels::spatial_holes_fill_radius(static_cast<int>(get_option(RS2_OPTION_HOLES_FILL)));
+            const int halo = static_cast<int>(get_option(OPTION_ROI_HALO));
+
+            auto res = roi::copy_frame(f, source).as<video_frame>();
+            for (auto& r : regions)
+            {
+                region_of_interest outer, inner;
+                if (!roi::clip(r, halo, f.get_width(), f.get_height(), outer) ||
+                    !roi::clip(r, 0, f.get_width(), f.get_height(), inner))
+                    continue;
+
+                const int w = outer.max_x - outer.min_x + 1;
+                const int h = outer.max_y - outer.min_y + 1;
+                if (_work.size() < size_t(w) * h) _work.resize(size_t(w) * h);
+                auto row = [&](int y) { return _work.data() + size_t(y) * w; };
+
+                for (int y = 0; y < h; ++y)
+                    roi::load_segment(f, outer.min_x, outer.min_y + y, w, row(y));
+
+                for (int i = 0; i < iterations; ++i)
+                {
+                    for (int y = 0; y < h; ++y)
+                        kernels::spatial_horizontal_row(row(y), w, alpha, delta);
+                    for (int y = 1; y < h; ++y)
+                        kernels::spatial_vertical_step(row(y - 1), row(y), w, alpha, delta);
+                    for (int y = h - 2; y >= 0; --y)
+                        kernels::spatial_vertical_step(row(y + 1), row(y), w, alpha, delta);
+                }
+
+                // Only the region is written back, the halo was context
+                const int dx = inner.min_x - outer.min_x;
+                const int count = inner.max_x - inner.min_x + 1;
+                for (int y = inner.min_y; y <= inner.max_y; ++y)
+                {
+                    float* values = row(y - outer.min_y);
+                    kernels::holes_fill_row(values, w, radius);
+                    roi::store_segment(values + dx, inner.min_x, y, count, res);
+                }
+            }
+            source.frame_ready(res);
+        }
+
+        roi::region_list _regions;
+        std::vector<float> _work;       // Grows to the largest region seen
+    };
+
+    /**
+    * Temporal filter restricted to regions of interest. Pixels outside all regions pass through untouched.
+    * History is kept per pixel like in temporal_filter, but only for the tiles of the frame currently covered by a region:
+    * tiles are created when a region first covers them and dropped once no region has covered them for EVICT_FRAMES frames,
+    * so memory and time scale with the tracked area. Options match temporal_filter; with no regions set the frame passes through.
+    */
+    class roi_temporal_filter : public filter
+    {
+    public:
+        static const int TILE = 32;
+        static const int EVICT_FRAMES = 30;
+
+        roi_temporal_filter() : filter([this](frame f, frame_source& s) { func(f, s); })
+        {
+            register_simple_option(RS2_OPTION_FILTER_SMOOTH_ALPHA, option_range{ 0.f, 1.f, 0.4f, 0.01f });
+            register_simple_option(RS2_OPTION_FILTER_SMOOTH_DELTA, option_range{ 1, 100, 20, 1 });
+            register_simple_option(RS2_OPTION_HOLES_FILL, option_range{ 0, 8, 3, 1 });
+        }
+
+        void set_regions(const std::vector<region_of_interest>& regions) { _regions.set(regions); }
+        std::vector<region_of_interest> get_regions() const { return _regions.get(); }
+
+        /**
+        * Number of history tiles currently held
+        */
+        size_t tiles() const
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _tiles.size();
+        }
+
+    private:
+        struct tile
+        {
+            tile() : last(TILE * TILE, 0.f), history(TILE * TILE, 0) {}
+            std::vector<float> last;
+            std::vector<uint8_t> history;
+            uint64_t used = 0;
+        };
+
+        struct segment
+        {
+            int y, min_x, max_x;    // inclusive
+        };
+
+        void func(frame data, frame_source& source)
+        {
+            auto f = data.as<video_frame>();
+            auto regions = _regions.get();
+            if (!f || !roi::is_supported(f) || regions.empty())
+            {
+                source.frame_ready(data);
+                return;
+            }
+
+            const float alpha = get_option(RS2_OPTION_FILTER_SMOOTH_ALPHA);
+            const float delta = get_option(RS2_OPTION_FILTER_SMOOTH_DELTA);
+            const int persistence = static_cast<int>(get_option(RS2_OPTION_HOLES_FILL));
+
+            std::lock_guard<std::mutex> lock(_mutex);
+            const int uid = f.get_profile().unique_id();
+            if (uid != _source_uid || f.get_width() != _width || f.get_height() != _height)
+            {
+                _tiles.clear();
+                _source_uid = uid;
+                _width = f.get_width();
+                _height = f.get_height();
+            }
+            if (persistence != _persistence.mode())
+                _persistence = kernels::persistence_table(persistence);
+            ++_frame;
+
+            auto res = roi::copy_frame(f, source).as<video_frame>();
+            const int tiles_x = (_width + TILE - 1) / TILE;
+            for (auto& s : coverage(regions))
+            {
+                // A pixel is filtered once per frame, even when covered by several regions
+                for (int x0 = s.min_x; x0 <= s.max_x;)
+                {
+                    const int tx = x0 / TILE, ty = s.y / TILE;
+                    const int x1 = std::min(s.max_x, (tx + 1) * TILE - 1);
+                    const int count = x1 - x0 + 1;
+
+                    auto& t = _tiles[ty * tiles_x + tx];
+                    t.used = _frame;
+                    const size_t offset = size_t(s.y % TILE) * TILE + (x0 % TILE);
+
+                    _segment.resize(count);
+                    roi::load_segment(f, x0, s.y, count, _segment.data());
+                    kernels::temporal_row(_segment.data(), t.last.data() + offset, t.history.data() + offset, count,
+                        alpha, delta, _persistence);
+                    roi::store_segment(_segment.data(), x0, s.y, count, res);
+                    x0 = x1 + 1;
+                }
+            }
+
+            for (auto it = _tiles.begin(); it != _tiles.end();)
+            {
+                if (_frame - it->second.used > EVICT_FRAMES) it = _tiles.erase(it);
+                else ++it;
+            }
+            source.frame_ready(res);
+        }
+
+        /**
+        * Row segments covered by the union of the regions
+        */
+        std::vector<segment> coverage(const std::vector<region_of_interest>& regions) const
+        {
+            std::vector<region_of_interest> clipped;
+            for (auto& r : regions)
+            {
+                region_of_interest c;
+                if (roi::clip(r, 0, _width, _height, c)) clipped.push_back(c);
+            }
+            std::sort(clipped.begin(), clipped.end(),
+                [](const region_of_interest& a, const region_of_interest& b) { return a.min_x < b.min_x; });
+
+            std::vector<segment> result;
+            if (clipped.empty()) return result;
+            int top = _height, bottom = -1;
+            for (auto& c : clipped)
+            {
+                top = std::min(top, c.min_y);
+                bottom = std::max(bottom, c.max_y);
+            }
+            for (int y = top; y <= bottom; ++y)
+            {
+                const size_t first = result.size();
+                for (auto& c : clipped)
+                {
+                    if (y < c.min_y || y > c.max_y) continue;
+                    if (result.size() > first && c.min_x <= result.back().max_x + 1)
+                        result.back().max_x = std::max(result.back().max_x, c.max_x);
+                    else
+                        result.push_back({ y, c.min_x, c.max_x });
+                }
+            }
+            return result;
+        }
+
+        roi::region_list _regions;
+        mutable std::mutex _mutex;
+        std::map<int, tile> _tiles;
+        std::vector<float> _segment;
+        kernels::persistence_table _persistence;
+        int _source_uid = -1;
+        int _width = 0;
+        int _height = 0;
+        uint64_t _frame = 0;
+    };
+}
+
+#endif
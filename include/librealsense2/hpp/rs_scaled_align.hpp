@@ -0,0 +1,225 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2017 Intel Corporation. All Rights Reserved.
+
+#ifndef LIBREALSENSE_RS2_SCALED_ALIGN_HPP
+#define LIBREALSENSE_RS2_SCALED_ALIGN_HPP
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include "rs_processing.hpp"
+#include "rs_depth_kernels.hpp"
+#include "../rsutil.h"
+
+namespace rs2
+{
+    /**
+    * Nearest-neighbor upsampling of a Z16 image by an integer factor.
+    * dst must hold (src_width * factor) x (src_height * factor) pixels. Consumers that
+    * only occasionally need the full-resolution view can call this on demand instead of
+    * asking scaled_align to upsample every frame.
+    */
+    inline void upsample_nearest(const uint16_t* src, int src_width, int src_height, int factor, uint16_t* dst)
+    {
+        const int dst_width = src_width * factor;
+        for (int y = 0; y < src_height; ++y)
+        {
+            auto out = dst + size_t(y) * factor * dst_width;
+            auto in = src + size_t(y) * src_width;
+            for (int x = 0; x < src_width; ++x)
+                for (int i = 0; i < factor; ++i)
+                    *out++ = in[x];
+            for (int i = 1; i < factor; ++i)
+                memcpy(dst + (size_t(y) * factor + i) * dst_width, dst + size_t(y) * factor * dst_width, dst_width * sizeof(uint16_t));
+        }
+    }
+
+    /**
+    * Aligns depth into the viewport of another stream, downscaled by an integer factor.
+    * The output depth frame carries a cloned profile with intrinsics scaled to match the reduced viewport,
+    * so it can be deprojected like any other depth frame. Since only one depth sample per output pixel is
+    * projected, the work drops by the square of the scale factor compared to rs2::align.
+    * Other frames of the frameset are passed through unchanged.
+    */
+    class scaled_align : public filter
+    {
+    public:
+        static const auto OPTION_ALIGN_SCALE = rs2_option(RS2_OPTION_COUNT + 20);
+        static const auto OPTION_ALIGN_UPSAMPLE = rs2_option(RS2_OPTION_COUNT + 21);
+
+        /**
+        * Create scaled align processing block
+        * \param[in] align_to       The stream type to which depth is aligned. Aligning to depth itself is not supported.
+        * \param[in] scale          Integer factor by which the target viewport is downscaled.
+        */
+        scaled_align(rs2_stream align_to = RS2_STREAM_COLOR, int scale = 2)
+            : filter([this](frame f, frame_source& s) { func(f, s); }), _align_to(align_to)
+        {
+            if (align_to == RS2_STREAM_DEPTH)
+                throw std::runtime_error("scaled_align can only align depth to another stream");
+
+            register_simple_option(OPTION_ALIGN_SCALE, option_range{ 1, 8, 2, 1 });
+            register_simple_option(OPTION_ALIGN_UPSAMPLE, option_range{ 0, 1, 0, 1 });
+            set_option(OPTION_ALIGN_SCALE, float(scale));
+        }
+
+        frameset process(frameset frames)
+        {
+            return filter::process(frames);
+        }
+
+    private:
+        void func(frame data, frame_source& source)
+        {
+            auto fs = data.as<frameset>();
+            if (!fs)
+            {
+                source.frame_ready(data);
+                return;
+            }
+
+            auto depth = fs.get_depth_frame();
+            auto other = fs.first_or_default(_align_to).as<video_frame>();
+            if (!depth || !other)
+            {
+                source.frame_ready(data);
+                return;
+            }
+
+            const int factor = static_cast<int>(get_option(OPTION_ALIGN_SCALE));
+            const bool upsample = get_option(OPTION_ALIGN_UPSAMPLE) != 0;
+
+            update_profiles(depth, other, factor);
+
+            auto out_width = _scaled_intrinsics.width;
+            auto out_height = _scaled_intrinsics.height;
+            frame aligned;
+            uint16_t* out;
+            if (upsample)
+            {
+                // Align into scratch memory and only allocate the full resolution frame
+                _scratch.assign(size_t(out_width) * out_height, 0);
+                out = _scratch.data();
+            }
+            else
+            {
+                aligned = source.allocate_video_frame(_scaled_profile, depth, 2, out_width, out_height,
+                    out_width * 2, RS2_EXTENSION_DEPTH_FRAME);
+                out = (uint16_t*)aligned.get_data();
+                memset(out, 0, size_t(out_width) * out_height * sizeof(uint16_t));
+            }
+
+            align_z(depth, factor, out);
+
+            if (upsample)
+            {
+                aligned = source.allocate_video_frame(_full_profile, depth, 2, out_width * factor, out_height * factor,
+                    out_width * factor * 2, RS2_EXTENSION_DEPTH_FRAME);
+                upsample_nearest(_scratch.data(), out_width, out_height, factor, (uint16_t*)aligned.get_data());
+            }
+
+            std::vector<frame> frames;
+            for (auto f : fs)
+            {
+                if (f.get_profile().stream_type() == RS2_STREAM_DEPTH && f.get_profile().format() == RS2_FORMAT_Z16)
+                    frames.push_back(aligned);
+                else
+                    frames.push_back(f);
+            }
+            source.frame_ready(source.allocate_composite_frame(frames));
+        }
+
+        void update_profiles(const depth_frame& depth, const video_frame& other, int factor)
+        {
+            auto depth_profile = depth.get_profile().as<video_stream_profile>();
+            auto other_profile = other.get_profile().as<video_stream_profile>();
+            if (_scaled_profile && factor == _factor &&
+                depth_profile.unique_id() == _depth_uid && other_profile.unique_id() == _other_uid)
+                return;
+
+            _depth_intrinsics = depth_profile.get_intrinsics();
+            _extrinsics = depth_profile.get_extrinsics_to(other_profile);
+
+            auto other_intrinsics = other_profile.get_intrinsics();
+            _scaled_intrinsics = scale_intrinsics(other_intrinsics, factor);
+            _scaled_profile = depth_profile.clone(RS2_STREAM_DEPTH, depth_profile.stream_index(), RS2_FORMAT_Z16,
+                _scaled_intrinsics.width, _scaled_intrinsics.height, _scaled_intrinsics);
+
+            // Full resolution profile for the upsampled output covers the (possibly cropped) multiple of the factor
+            auto full_intrinsics = other_intrinsics;
+            full_intrinsics.width = _scaled_intrinsics.width * factor;
+            full_intrinsics.height = _scaled_intrinsics.height * factor;
+            _full_profile = depth_profile.clone(RS2_STREAM_DEPTH, depth_profile.stream_index(), RS2_FORMAT_Z16,
+                full_intrinsics.width, full_intrinsics.height, full_intrinsics);
+
+            _factor = factor;
+            _depth_uid = depth_profile.unique_id();
+            _other_uid = other_profile.unique_id();
+        }
+
+        // Project one depth sample per factor x factor block of depth pixels into the reduced viewport.
+        // Each sample covers the block's footprint, and the nearest surface wins where footprints overlap.
+        void align_z(const depth_frame& depth, int factor, uint16_t* out) const
+        {
+            const auto in = reinterpret_cast<const uint16_t*>(depth.get_data());
+            const float units = depth.get_units();
+            const int dw = _depth_intrinsics.width, dh = _depth_intrinsics.height;
+            const int ow = _scaled_intrinsics.width, oh = _scaled_intrinsics.height;
+
+            for (int y = 0; y < dh; y += factor)
+            {
+                const int cy = std::min(y + factor / 2, dh - 1);
+                for (int x = 0; x < dw; x += factor)
+                {
+                    const int cx = std::min(x + factor / 2, dw - 1);
+                    const uint16_t z = in[cy * dw + cx];
+                    if (!z) continue;
+
+                    const float depth_m = z * units;
+                    int px0, py0, px1, py1;
+                    if (!project_corner(x - 0.5f, y - 0.5f, depth_m, px0, py0) ||
+                        !project_corner(x + factor - 0.5f, y + factor - 0.5f, depth_m, px1, py1))
+                        continue;
+
+                    px0 = std::max(px0, 0); py0 = std::max(py0, 0);
+                    px1 = std::min(px1, ow - 1); py1 = std::min(py1, oh - 1);
+                    for (int oy = py0; oy <= py1; ++oy)
+                    {
+                        for (int ox = px0; ox <= px1; ++ox)
+                        {
+                            auto& o = out[oy * ow + ox];
+                            if (!o || z < o) o = z;
+                        }
+                    }
+                }
+            }
+        }
+
+        bool project_corner(float x, float y, float depth_m, int& ox, int& oy) const
+        {
+            float pixel[2] = { x, y }, point[3], other_point[3], other_pixel[2];
+            rs2_deproject_pixel_to_point(point, &_depth_intrinsics, pixel, depth_m);
+            rs2_transform_point_to_point(other_point, &_extrinsics, point);
+            if (other_point[2] <= 0) return false;
+            rs2_project_point_to_pixel(other_pixel, &_scaled_intrinsics, other_point);
+            ox = static_cast<int>(std::round(other_pixel[0]));
+            oy = static_cast<int>(std::round(other_pixel[1]));
+            return true;
+        }
+
+        rs2_stream _align_to;
+        int _factor = 0;
+        int _depth_uid = -1;
+        int _other_uid = -1;
+        rs2_intrinsics _depth_intrinsics;
+        rs2_intrinsics _scaled_intrinsics;
+        rs2_extrinsics _extrinsics;
+        stream_profile _scaled_profile;
+        stream_profile _full_profile;
+        std::vector<uint16_t> _scratch;
+    };
+}
+
+#endif
@@ -0,0 +1,321 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2017 Intel Corporation. All Rights Reserved.
+
+#ifndef LIBREALSENSE_RS2_STATIC_CHAIN_HPP
+#define LIBREALSENSE_RS2_STATIC_CHAIN_HPP
+
+#include <mutex>
+#include <tuple>
+#include <vector>
+#include <utility>
+#include <cstring>
+#include <algorithm>
+#include "rs_processing.hpp"
+#include "rs_depth_kernels.hpp"
+#include "rs_fused_filter.hpp"
+
+namespace rs2
+{
+    namespace chain
+    {
+        /**
+        * Image passed from stage to stage of a static_filter_chain. Holds the data either as Z16 or in the float working domain,
+        * converting lazily when a stage asks for the other representation, in scratch buffers that are reused from frame to frame.
+        */
+        class image
+        {
+        public:
+            int width = 0;
+            int height = 0;
+            float units = 0.001f;
+
+            /**
+            * Load a Z16 frame of the given size
+            */
+            void load(const uint16_t* data, int w, int h, float depth_units, const depth_output_profile& output)
+            {
+                width = w;
+                height = h;
+                units = depth_units;
+                _output = &output;
+                _depth.assign(data, data + size_t(w) * h);
+                _is_float = false;
+                _disparity = false;
+            }
+
+            /**
+            * Z16 data, converted back to depth first if the image holds disparity
+            */
+            uint16_t* depth()
+            {
+                if (_is_float)
+                {
+                    _depth.resize(size());
+                    kernels::from_working_row(_work.data(), _depth.data(), int(size()), _disparity ? d2d() : 0.f);
+                    _is_float = false;
+                    _disparity = false;
+                }
+                return _depth.data();
+            }
+
+            /**
+            * Float working data, depth or disparity
+            */
+            float* working()
+            {
+                if (!_is_float)
+                {
+                    _work.resize(size());
+                    kernels::to_working_row(_depth.data(), _work.data(), int(size()), 0.f);
+                    _is_float = true;
+                }
+                return _work.data();
+            }
+
+            /**
+            * Switch the working domain between depth and disparity. Does nothing for sensors without a stereo baseline.
+            */
+            void set_disparity(bool disparity)
+            {
+                const float factor = d2d();
+                if (disparity == _disparity || !factor) return;
+                float* data = working();
+                for (size_t i = 0; i < size(); ++i)
+                    data[i] = data[i] > 0 ? factor / data[i] : 0.f;
+                _disparity = disparity;
+            }
+
+            bool is_disparity() const { return _disparity; }
+
+            /**
+            * Resize the image, e.g. after decimation. Returns the scratch Z16 buffer to fill.
+            */
+            uint16_t* resize_depth(int w, int h)
+            {
+                _scratch.resize(size_t(w) * h);
+                return _scratch.data();
+            }
+
+            /**
+            * Make the buffer returned by resize_depth current
+            */
+            void commit_depth(int w, int h)
+            {
+                std::swap(_depth, _scratch);
+                width = w;
+                height = h;
+                _is_float = false;
+                _disparity = false;
+            }
+
+            size_t size() const { return size_t(width) * height; }
+
+            /**
+            * Write the result as Z16
+            */
+            void store(uint16_t* out)
+            {
+                if (_is_float)
+                    kernels::from_working_row(_work.data(), out, int(size()), _disparity ? d2d() : 0.f);
+                else
+                    memcpy(out, _depth.data(), size() * sizeof(uint16_t));
+            }
+
+        private:
+            float d2d() const { return _output ? _output->d2d(width, units) : 0.f; }
+
+            const depth_output_profile* _output = nullptr;
+            std::vector<uint16_t> _depth;
+            std::vector<uint16_t> _scratch;
+            std::vector<float> _work;
+            bool _is_float = false;
+            bool _disparity = false;
+        };
+
+        /**
+        * Stages of a static_filter_chain. Parameters have the meaning and defaults of the matching SDK processing block.
+        * A stage is any copyable type with the two members below, so applications can add their own:
+        *   void output_size(int& width, int& height) const - output size for an input of the given size
+        *   void operator()(image& img)                    - process the image in place
+        */
+        struct decimation
+        {
+            int magnitude = 2;
+
+            void output_size(int& w, int& h) const { w /= m(); h /= m(); }
+            void operator()(image& img) const
+            {
+                if (m() == 1) return;
+                int w = img.width, h = img.height;
+                output_size(w, h);
+                const uint16_t* in = img.depth();
+                uint16_t* out = img.resize_depth(w, h);
+                for (int y = 0; y < h; ++y)
+                    kernels::decimate_row(in + size_t(y) * m() * img.width, img.width, m(), out + size_t(y) * w);
+                img.commit_depth(w, h);
+            }
+
+        private:
+            int m() const { return std::max(1, std::min(magnitude, 8)); }
+        };
+
+        struct threshold
+        {
+            float min_distance = 0.15f;     // meters
+            float max_distance = 4.f;       // meters
+
+            void output_size(int&, int&) const {}
+            void operator()(image& img) const
+            {
+                // Depth is the native domain of the threshold; other domains are converted back first
+                kernels::threshold_row(img.depth(), int(img.size()), min_distance / img.units, max_distance / img.units);
+            }
+        };
+
+        struct depth_to_disparity
+        {
+            void output_size(int&, int&) const {}
+            void operator()(image& img) const { img.set_disparity(true); }
+        };
+
+        struct disparity_to_depth
+        {
+            void output_size(int&, int&) const {}
+            void operator()(image& img) const { img.set_disparity(false); }
+        };
+
+        struct spatial
+        {
+            int iterations = 2;
+            float alpha = 0.5f;
+            float delta = 20.f;
+            int holes_fill = 0;
+
+            void output_size(int&, int&) const {}
+            void operator()(image& img) const
+            {
+                const int w = img.width, h = img.height;
+                float* data = img.working();
+                auto row = [&](int y) { return data + size_t(y) * w; };
+                for (int i = 0; i < iterations; ++i)
+                {
+                    for (int y = 0; y < h; ++y)
+                        kernels::spatial_horizontal_row(row(y), w, alpha, delta);
+                    for (int y = 1; y < h; ++y)
+                        kernels::spatial_vertical_step(row(y - 1), row(y), w, alpha, delta);
+                    for (int y = h - 2; y >= 0; --y)
+                        kernels::spatial_vertical_step(row(y + 1), row(y), w, alpha, delta);
+                }
+                const int radius = kernels::spatial_holes_fill_radius(holes_fill);
+                for (int y = 0; y < h && radius; ++y)
+                    kernels::holes_fill_row(row(y), w, radius);
+            }
+        };
+
+        struct temporal
+        {
+            float alpha = 0.4f;
+            float delta = 20.f;
+            int persistence = 3;
+
+            void output_size(int&, int&) const {}
+            void operator()(image& img)
+            {
+                float* data = img.working();
+                if (_last.size() != img.size() || _disparity != img.is_disparity())
+                {
+                    _last.assign(img.size(), 0.f);
+                    _history.assign(img.size(), 0);
+                    _disparity = img.is_disparity();
+                }
+                if (persistence != _table.mode())
+                    _table = kernels::persistence_table(persistence);
+                kernels::temporal_row(data, _last.data(), _history.data(), int(img.size()), alpha, delta, _table);
+            }
+
+        private:
+            std::vector<float> _last;
+            std::vector<uint8_t> _history;
+            kernels::persistence_table _table;
+            bool _disparity = false;
+        };
+    }
+
+    /**
+    * Depth post-processing chain composed at compile time, e.g.
+    *   static_filter_chain<chain::decimation, chain::threshold, chain::depth_to_disparity, chain::spatial, chain::temporal, chain::disparity_to_depth>
+    * Stages are called directly rather than through processing blocks, so they can be inlined, and intermediate results
+    * stay in scratch buffers reused from frame to frame. Only the final result is allocated as an rs2::frame.
+    * The chain is itself a filter: it accepts depth frames or framesets (replacing the depth frame) and can be combined
+    * with runtime processing blocks, frame queues and filter graphs.
+    */
+    template<class... Stages>
+    class static_filter_chain : public filter
+    {
+    public:
+        static_filter_chain() : filter([this](frame f, frame_source& s) { func(f, s); }) {}
+
+        /**
+        * Change the parameters of a stage, e.g. chain.configure<chain::spatial>([](chain::spatial& s) { s.iterations = 3; });
+        * Safe to call while frames are being processed.
+        */
+        template<class S, class F>
+        void configure(F f)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            f(std::get<S>(_stages));
+        }
+
+    private:
+        typedef std::index_sequence_for<Stages...> stage_indices;
+
+        template<size_t... I>
+        void output_size(int& w, int& h, std::index_sequence<I...>) const
+        {
+            int expand[] = { 0, (std::get<I>(_stages).output_size(w, h), 0)... };
+            (void)expand;
+        }
+
+        template<size_t... I>
+        void run(chain::image& img, std::index_sequence<I...>)
+        {
+            int expand[] = { 0, (std::get<I>(_stages)(img), 0)... };
+            (void)expand;
+        }
+
+        void func(frame data, frame_source& source)
+        {
+            auto fs = data.as<frameset>();
+            depth_frame depth = fs ? fs.get_depth_frame() : data.as<depth_frame>();
+            if (!depth)
+            {
+                source.frame_ready(data);
+                return;
+            }
+
+            frame res;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                int ow = depth.get_width(), oh = depth.get_height();
+                output_size(ow, oh, stage_indices());
+                _output.update(depth, ow, oh);
+
+                _image.load(reinterpret_cast<const uint16_t*>(depth.get_data()), depth.get_width(), depth.get_height(),
+                    depth.get_units(), _output);
+                run(_image, stage_indices());
+
+                res = source.allocate_video_frame(_output.profile(), depth, 2, ow, oh, ow * 2, RS2_EXTENSION_DEPTH_FRAME);
+                _image.store((uint16_t*)res.get_data());
+            }
+
+            source.frame_ready(fs ? replace_depth(fs, res, source) : res);
+        }
+
+        std::mutex _mutex;
+        std::tuple<Stages...> _stages;
+        chain::image _image;
+        depth_output_profile _output;
+    };
+}
+
+#endif
@@ -0,0 +1,221 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2017 Intel Corporation. All Rights Reserved.
+
+#ifndef LIBREALSENSE_RS2_STREAM_STATS_HPP
+#define LIBREALSENSE_RS2_STREAM_STATS_HPP
+
+#include <cmath>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include "rs_frame.hpp"
+
+namespace rs2
+{
+    /**
+    * Health statistics of every stream delivered to a callback: frames received, frames dropped on the way (detected from
+    * gaps in frame numbers), jitter of the arrival times and the time spent in the callback.
+    * Every stream has its own set of atomic counters, so callbacks of different sensors never contend, and nothing on
+    * the frame path takes a lock. Snapshots can be read at any time from any thread without blocking the callbacks;
+    * the fields of a snapshot are read one by one and may be a frame apart from each other.
+    * Like frame_queue, copies of the object share the same counters.
+    */
+    class stream_statistics
+    {
+    public:
+        struct snapshot
+        {
+            int unique_id;              // Stream profile the counters belong to
+            rs2_stream stream;
+            int index;
+            uint64_t frames;            // Frames received
+            uint64_t drops;             // Frames missing between the received frame numbers
+            float interval_ms;          // Mean time between arrivals
+            float jitter_ms;            // Mean deviation of the time between arrivals from its mean
+            float callback_last_ms;     // Time spent in the callback by the last frame
+            float callback_mean_ms;
+            float callback_max_ms;
+        };
+
+        stream_statistics() : _impl(std::make_shared<impl>()) {}
+
+        /**
+        * Record the arrival of a frame, or of every frame of a frameset
+        */
+        void record_arrival(const frame& f) const
+        {
+            const int64_t now = impl::now_ns();
+            for_each_stream(f, [&](const frame& sub, counters& c) { c.arrival(sub, now); });
+        }
+
+        /**
+        * Record the time spent processing a frame, or every frame of a frameset
+        */
+        void record_duration(const frame& f, int64_t duration_ns) const
+        {
+            for_each_stream(f, [&](const frame&, counters& c) { c.duration(duration_ns); });
+        }
+
+        /**
+        * Wrap a frame callback, recording arrivals and the time spent in the callback, e.g.
+        *   pipe.start(stats.wrap([](const rs2::frame& f) { ... }));
+        */
+        template<class F>
+        std::function<void(frame)> wrap(F callback) const
+        {
+            stream_statistics stats = *this;
+            return [stats, callback](frame f) mutable {
+                const int64_t start = impl::now_ns();
+                stats.record_arrival(f);
+                callback(f);
+                stats.record_duration(f, impl::now_ns() - start);
+            };
+        }
+
+        /**
+        * Current statistics of all streams seen so far. Does not block the callbacks.
+        */
+        std::vector<snapshot> get_snapshot() const
+        {
+            std::vector<snapshot> res;
+            for (auto& c : _impl->slots)
+            {
+                const int uid = c.uid.load(std::memory_order_acquire);
+                if (uid < 0) continue;
+                const uint64_t frames = c.frames.load(std::memory_order_relaxed);
+                const uint64_t calls = c.calls.load(std::memory_order_relaxed);
+                res.push_back({ uid, rs2_stream(c.stream.load(std::memory_order_relaxed)), c.index.load(std::memory_order_relaxed),
+                    frames, c.drops.load(std::memory_order_relaxed),
+                    c.interval_ms.load(std::memory_order_relaxed), c.jitter_ms.load(std::memory_order_relaxed),
+                    c.callback_last_ns.load(std::memory_order_relaxed) * 1e-6f,
+                    calls ? float(double(c.callback_total_ns.load(std::memory_order_relaxed)) / calls * 1e-6) : 0.f,
+                    c.callback_max_ns.load(std::memory_order_relaxed) * 1e-6f });
+            }
+            return res;
+        }
+
+        /**
+        * Zero all counters. Streams stay registered.
+        */
+        void reset() const
+        {
+            for (auto& c : _impl->slots)
+                c.reset();
+        }
+
+    private:
+        // Counters of one stream. Frames of a stream come from a single sensor thread,
+        // so the counters only need to be atomic towards the readers of snapshots
+        struct counters
+        {
+            std::atomic<int> uid{ -1 };
+            std::atomic<int> stream{ 0 };
+            std::atomic<int> index{ 0 };
+            std::atomic<uint64_t> frames{ 0 };
+            std::atomic<uint64_t> drops{ 0 };
+            std::atomic<uint64_t> last_number{ 0 };
+            std::atomic<int64_t> last_arrival_ns{ 0 };
+            std::atomic<float> interval_ms{ 0.f };
+            std::atomic<float> jitter_ms{ 0.f };
+            std::atomic<uint64_t> calls{ 0 };
+            std::atomic<uint64_t> callback_last_ns{ 0 };
+            std::atomic<uint64_t> callback_total_ns{ 0 };
+            std::atomic<uint64_t> callback_max_ns{ 0 };
+
+            void arrival(const frame& f, int64_t now)
+            {
+                static const float SMOOTHING = 0.05f;
+
+                const uint64_t number = f.get_frame_number();
+                const uint64_t last = last_number.exchange(number, std::memory_order_relaxed);
+                const int64_t previous = last_arrival_ns.exchange(now, std::memory_order_relaxed);
+                if (frames.fetch_add(1, std::memory_order_relaxed) == 0) return;
+
+                // A frame number going backwards means the stream was restarted
+                if (number > last + 1)
+                    drops.fetch_add(number - last - 1, std::memory_order_relaxed);
+
+                const float interval = (now - previous) * 1e-6f;
+                float mean = interval_ms.load(std::memory_order_relaxed);
+                mean = mean ? mean + (interval - mean) * SMOOTHING : interval;
+                interval_ms.store(mean, std::memory_order_relaxed);
+                const float jitter = jitter_ms.load(std::memory_order_relaxed);
+                jitter_ms.store(jitter + (std::fabs(interval - mean) - jitter) * SMOOTHING, std::memory_order_relaxed);
+            }
+
+            void duration(int64_t ns)
+            {
+                const uint64_t d = static_cast<uint64_t>(std::max<int64_t>(ns, 0));
+                callback_last_ns.store(d, std::memory_order_relaxed);
+                callback_total_ns.fetch_add(d, std::memory_order_relaxed);
+                calls.fetch_add(1, std::memory_order_relaxed);
+                auto max = callback_max_ns.load(std::memory_order_relaxed);
+                while (d > max && !callback_max_ns.compare_exchange_weak(max, d, std::memory_order_relaxed)) {}
+            }
+
+            void reset()
+            {
+                frames = 0; drops = 0; interval_ms = 0.f; jitter_ms = 0.f;
+                calls = 0; callback_last_ns = 0; callback_total_ns = 0; callback_max_ns = 0;
+            }
+        };
+
+        struct impl
+        {
+            static const int MAX_STREAMS = 32;
+            static const int CLAIMING = -2;
+
+            static int64_t now_ns()
+            {
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+            }
+
+            // Counters of the stream, claimed on its first frame
+            counters* find(const frame& f)
+            {
+                auto profile = f.get_profile();
+                const int uid = profile.unique_id();
+                for (auto& c : slots)
+                {
+                    int current = c.uid.load(std::memory_order_acquire);
+                    if (current == -1 && c.uid.compare_exchange_strong(current, CLAIMING, std::memory_order_acq_rel))
+                    {
+                        c.stream.store(profile.stream_type(), std::memory_order_relaxed);
+                        c.index.store(profile.stream_index(), std::memory_order_relaxed);
+                        c.uid.store(uid, std::memory_order_release);
+                        return &c;
+                    }
+                    // Another sensor thread is claiming the slot, which takes a few instructions
+                    while (current == CLAIMING)
+                        current = c.uid.load(std::memory_order_acquire);
+                    if (current == uid) return &c;
+                }
+                return nullptr; // More streams than slots, these are not counted
+            }
+
+            counters slots[MAX_STREAMS];
+        };
+
+        template<class F>
+        void for_each_stream(const frame& f, F action) const
+        {
+            if (auto fs = f.as<frameset>())
+            {
+                for (const frame& sub : fs)
+                    if (auto c = _impl->find(sub)) action(sub, *c);
+            }
+            else if (auto c = _impl->find(f))
+            {
+                action(f, *c);
+            }
+        }
+
+        std::shared_ptr<impl> _impl;
+    };
+}
+
+#endif
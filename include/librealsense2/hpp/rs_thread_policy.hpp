@@ -0,0 +1,81 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2017 Intel Corporation. All Rights Reserved.
+
+#ifndef LIBREALSENSE_RS2_THREAD_POLICY_HPP
+#define LIBREALSENSE_RS2_THREAD_POLICY_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <functional>
+#include "../rs.hpp"
+#include "rs_platform.hpp"
+
+namespace rs2
+{
+    /**
+    * Placement of a thread: the CPUs it may run on, real-time priority and a name shown by debuggers and profilers.
+    * Pinning latency-critical threads to cores reserved for them, e.g. with isolcpus, keeps them from being migrated
+    * and preempted by GUI or logging work. Real-time priority usually requires elevated privileges (CAP_SYS_NICE on Linux);
+    * settings that cannot be applied are reported through the SDK log and the thread keeps running as before.
+    */
+    struct thread_policy
+    {
+        std::vector<int> cpus;      // CPUs the thread may run on, empty for any
+        int realtime_priority = 0;  // SCHED_FIFO priority 1-99 on Linux, time-critical priority on Windows; 0 leaves the scheduling unchanged
+        std::string name;           // Thread name, empty to leave unchanged. Linux truncates names to 15 characters
+
+        bool empty() const { return cpus.empty() && !realtime_priority && name.empty(); }
+
+        /**
+        * Apply the policy to the calling thread
+        * \param[in] suffix  Appended to the name, e.g. to number the threads of a pool
+        * \return false if any of the settings could not be applied
+        */
+        bool apply(const std::string& suffix = "") const
+        {
+            bool ok = true;
+            if (!cpus.empty()) ok &= check(platform::set_thread_affinity(cpus), "CPU affinity");
+            if (realtime_priority) ok &= check(platform::set_thread_realtime(realtime_priority), "real-time priority");
+            if (!name.empty()) ok &= check(platform::set_thread_name(name + suffix), "thread name");
+            return ok;
+        }
+
+    private:
+        static bool check(bool ok, const char* what)
+        {
+            if (!ok) log(RS2_LOG_SEVERITY_WARN, (std::string("Failed to set ") + what + " of thread").c_str());
+            return ok;
+        }
+    };
+
+    /**
+    * Wrap a frame callback so that the policy is applied to every thread the callback runs on, the first time it runs there.
+    * Since the SDK calls frame callbacks on its own threads, this is how sensor threads (with sensor::start) and the
+    * synchronization thread of a pipeline (with pipeline::start) are pinned and prioritized, e.g.
+    *   pipe.start(rs2::with_thread_policy(policy, [](rs2::frame f) { ... }));
+    */
+    template<class F>
+    std::function<void(frame)> with_thread_policy(const thread_policy& policy, F callback)
+    {
+        // Identifies the wrapper, so that a thread shared by callbacks with different policies applies each of them once
+        auto token = std::make_shared<thread_policy>(policy);
+        return [token, callback](frame f) mutable {
+            static thread_local std::vector<std::weak_ptr<thread_policy>> applied;
+            bool found = false;
+            for (auto& w : applied)
+                if (w.lock() == token) found = true;
+            if (!found)
+            {
+                applied.erase(std::remove_if(applied.begin(), applied.end(),
+                    [](const std::weak_ptr<thread_policy>& w) { return w.expired(); }), applied.end());
+                applied.push_back(token);
+                token->apply();
+            }
+            callback(f);
+        };
+    }
+}
+
+#endif
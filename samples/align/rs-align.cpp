@@ -2,6 +2,7 @@
 // Copyright(c) 2019 Intel Corporation. All Rights Reserved.
 
 #include <librealsense2/rs.hpp>
+#include <librealsense2/hpp/rs_scaled_align.hpp>
 #include "example-imgui.hpp"
 
 /*
@@ -18,6 +19,9 @@
  2. Occlussion - Some pixels in the resulting image correspond to 3D coordinates that the original
                sensor did not see, because these 3D points were occluded in the original viewport.
                Such pixels may hold invalid texture values.
+ Aligning depth to color projects every depth pixel. When depth is only needed at a fraction of color resolution,
+ rs2::scaled_align aligns into the color viewport downscaled by an integer factor, cutting the work by the square of
+ the factor. The factor is set with --align-scale <n> (1 aligns at full resolution) or with the slider.
 */
 
 // This example assumes camera with depth and color
@@ -29,10 +33,14 @@ enum class direction
 };
 
 // Forward definition of UI rendering, implemented below
-void render_slider(rect location, float* alpha, direction* dir);
+void render_slider(rect location, float* alpha, direction* dir, int* scale);
 
 int main(int argc, char * argv[]) try
 {
+    int scale = 2;
+    for (int i = 1; i + 1 < argc; ++i)
+        if (!strcmp(argv[i], "--align-scale")) scale = std::max(1, std::min(std::atoi(argv[++i]), 8));
+
     std::string serial;
     if (!device_with_streams({ RS2_STREAM_COLOR,RS2_STREAM_DEPTH }, serial))
         return EXIT_SUCCESS;
@@ -55,9 +63,10 @@ int main(int argc, char * argv[]) try
     // Define two align objects. One will be used to align
     // to depth viewport and the other to color.
     // Creating align object is an expensive operation
-    // that should not be performed in the main loop
+    // that should not be performed in the main loop.
+    // Depth is aligned to color at a reduced resolution, the color frame is left as it is
     rs2::align align_to_depth(RS2_STREAM_DEPTH);
-    rs2::align align_to_color(RS2_STREAM_COLOR);
+    rs2::scaled_align align_to_color(RS2_STREAM_COLOR, scale);
 
     float       alpha = 0.5f;               // Transparancy coefficient
     direction   dir = direction::to_depth;  // Alignment direction
@@ -74,7 +83,8 @@ int main(int argc, char * argv[]) try
         }
         else
         {
-            // Align all frames to color viewport
+            // Align depth to the color viewport, downscaled by the selected factor
+            align_to_color.set_option(rs2::scaled_align::OPTION_ALIGN_SCALE, float(scale));
             frameset = align_to_color.process(frameset);
         }
 
@@ -107,7 +117,7 @@ int main(int argc, char * argv[]) try
 
         // Render the UI:
         ImGui_ImplGlfw_NewFrame(1);
-        render_slider({ 15.f, app.height() - 60, app.width() - 30, app.height() }, &alpha, &dir);
+        render_slider({ 15.f, app.height() - 85, app.width() - 30, app.height() }, &alpha, &dir, &scale);
         ImGui::Render();
     }
 
@@ -124,7 +134,7 @@ catch (const std::exception & e)
     return EXIT_FAILURE;
 }
 
-void render_slider(rect location, float* alpha, direction* dir)
+void render_slider(rect location, float* alpha, direction* dir, int* scale)
 {
     static const int flags = ImGuiWindowFlags_NoCollapse
         | ImGuiWindowFlags_NoScrollbar
@@ -159,5 +169,15 @@ void render_slider(rect location, float* alpha, direction* dir)
         *dir = to_color ? direction::to_color : direction::to_depth;
     }
 
+    // Render the scale of the alignment to color:
+    if (*dir == direction::to_color)
+    {
+        ImGui::PushItemWidth(-1);
+        ImGui::SliderInt("##Scale", scale, 1, 8);
+        ImGui::PopItemWidth();
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip("Color viewport downscale factor of aligned depth: %d", *scale);
+    }
+
     ImGui::End();
 }
@@ -2,39 +2,101 @@
 // Copyright(c) 2017 Intel Corporation. All Rights Reserved.
 
 #include <librealsense2/rs.hpp> // Include RealSense Cross Platform API
+#include <librealsense2/hpp/rs_stream_stats.hpp>
+#include <librealsense2/hpp/rs_thread_policy.hpp>
+#include <librealsense2/hpp/rs_coroutine.hpp>
 #include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <cstring>
+#include <cstdlib>
 #include <map>
 #include <chrono>
-#include <mutex>
 #include <thread>
 
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#define RS2_SAMPLE_COROUTINES
+#endif
+#endif
+
+#ifdef RS2_SAMPLE_COROUTINES
+// With --coroutine, frames are awaited by coroutines running on a single event loop thread instead
+int run_coroutines()
+{
+    rs2::co::event_loop loop;
+    rs2::co::async_pipeline pipe(loop);
+    pipe.start();
+
+    std::map<int, int> counters;
+    auto camera = [&]() -> rs2::co::task {
+        for (;;)
+        {
+            rs2::frameset fs = co_await pipe.next_frameset();
+            for (const rs2::frame& f : fs)
+                ++counters[f.get_profile().unique_id()];
+        }
+    };
+    auto report = [&]() -> rs2::co::task {
+        for (;;)
+        {
+            co_await loop.sleep_for(std::chrono::seconds(1));
+            std::cout << "\r";
+            for (auto p : counters)
+                std::cout << "[" << p.first << "]: " << p.second << " [frames] || ";
+            std::cout << std::flush;
+        }
+    };
+    camera();
+    report();
+    loop.run();
+    return EXIT_SUCCESS;
+}
+#endif
+
 // The callback example demonstrates asynchronous usage of the pipeline
 int main(int argc, char * argv[]) try
 {
     //rs2::log_to_console(RS2_LOG_SEVERITY_ERROR);
 
-    std::map<int, int> counters;
+    // Optionally pin the thread delivering the frames to a set of CPUs and give it real-time priority, e.g.
+    //   rs-callback --cpus 2,3 --fifo 50
+    // Comparing the jitter printed with and without these options shows their effect on latency
+    rs2::thread_policy policy;
+    policy.name = "rs2-callback";
+    for (int i = 1; i + 1 < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--cpus"))
+        {
+            std::stringstream list(argv[++i]);
+            std::string cpu;
+            while (std::getline(list, cpu, ','))
+                policy.cpus.push_back(std::atoi(cpu.c_str()));
+        }
+        else if (!strcmp(argv[i], "--fifo"))
+            policy.realtime_priority = std::atoi(argv[++i]);
+    }
+#ifdef RS2_SAMPLE_COROUTINES
+    for (int i = 1; i < argc; ++i)
+        if (!strcmp(argv[i], "--coroutine")) return run_coroutines();
+#endif
+
     std::map<int, std::string> stream_names;
-    std::mutex mutex;
+
+    // Per-stream statistics: frames, frames dropped on the way, arrival jitter and time spent in the callback.
+    // Every stream has its own atomic counters, so callbacks of different sensors never wait for each other
+    rs2::stream_statistics stats;
 
     // Define frame callback
     // The callback is executed on a sensor thread and can be called simultaneously from multiple sensors
-    // Therefore any modification to common memory should be done under lock
-    auto callback = [&](const rs2::frame& frame)
+    // Therefore any modification to common memory should be done under lock, or through atomic counters
+    // With callbacks, all synchronized stream will arrive in a single frameset, while streams that bypass
+    // synchronization (such as IMU) will produce single frames. The statistics count the frames of both
+    // The thread policy is applied to every thread the callback runs on, the first time it runs there
+    auto callback = rs2::with_thread_policy(policy, stats.wrap([](const rs2::frame&)
     {
-        std::lock_guard<std::mutex> lock(mutex);
-        if (rs2::frameset fs = frame.as<rs2::frameset>())
-        {
-            // With callbacks, all synchronized stream will arrive in a single frameset
-            for (const rs2::frame& f : fs)
-                counters[f.get_profile().unique_id()]++;
-        }
-        else
-        {
-            // Stream that bypass synchronization (such as IMU) will produce single frames
-            counters[frame.get_profile().unique_id()]++;
-        }
-    };
+        // Process the frame here
+    }));
 
     // Declare RealSense pipeline, encapsulating the actual device and sensors.
     rs2::pipeline pipe;
@@ -55,12 +117,12 @@ int main(int argc, char * argv[]) try
     {
         std::this_thread::sleep_for(std::chrono::seconds(1));
 
-        std::lock_guard<std::mutex> lock(mutex);
-
-        std::cout << "\r";
-        for (auto p : counters)
+        // Reading a snapshot does not block the sensor threads
+        std::cout << "\r" << std::fixed << std::setprecision(2);
+        for (auto&& s : stats.get_snapshot())
         {
-            std::cout << stream_names[p.first] << "[" << p.first << "]: " << p.second << " [frames] || ";
+            std::cout << stream_names[s.unique_id] << "[" << s.unique_id << "]: " << s.frames << " [frames] "
+                << s.drops << " [drops] " << s.jitter_ms << " [ms jitter] " << s.callback_mean_ms << " [ms callback] || ";
         }
     }
 
@@ -3,6 +3,11 @@
 
 #include <librealsense2/rs.hpp> // Include RealSense Cross Platform API
 #include "example.hpp"          // Include short list of convenience functions for rendering
+#include <librealsense2/hpp/rs_fused_filter.hpp>
+#include <librealsense2/hpp/rs_filter_graph.hpp>
+#include <librealsense2/hpp/rs_frame_ring.hpp>
+#include <librealsense2/hpp/rs_stream_stats.hpp>
+#include <librealsense2/hpp/rs_handoff.hpp>
 
 // This example will require several standard data-structures and algorithms:
 #define _USE_MATH_DEFINES
@@ -13,6 +18,7 @@
 #include <thread>
 #include <atomic>
 #include <mutex>
+#include <sstream>
 
 using pixel = std::pair<int, int>;
 
@@ -109,23 +115,20 @@ int main(int argc, char * argv[]) try
     rs2::colorizer color_map;
     // Use black to white color map
     color_map.set_option(RS2_OPTION_COLOR_SCHEME, 2.f);
-    // Decimation filter reduces the amount of data (while preserving best samples)
-    rs2::decimation_filter dec;
+    // Post-processing runs as one fused block. It applies the same stages as
+    // the decimation, disparity, spatial and temporal filters, without allocating intermediate frames
+    rs2::depth_chain_settings chain;
+    chain.threshold = false;
+    // Decimation reduces the amount of data (while preserving best samples)
     // If the demo is too slow, make sure you run in Release (-DCMAKE_BUILD_TYPE=Release)
     // but you can also increase the following parameter to decimate depth more (reducing quality)
-    dec.set_option(RS2_OPTION_FILTER_MAGNITUDE, 2);
-    // Define transformations from and to Disparity domain
-    rs2::disparity_transform depth2disparity;
-    rs2::disparity_transform disparity2depth(false);
-    // Define spatial filter (edge-preserving)
-    rs2::spatial_filter spat;
-    // Enable hole-filling
+    chain.decimation_magnitude = 2;
+    // Enable hole-filling of the spatial (edge-preserving) stage
     // Hole filling is an agressive heuristic and it gets the depth wrong many times
     // However, this demo is not built to handle holes
     // (the shortest-path will always prefer to "cut" through the holes since they have zero 3D distance)
-    spat.set_option(RS2_OPTION_HOLES_FILL, 5); // 5 = fill all the zero pixels
-    // Define temporal filter
-    rs2::temporal_filter temp;
+    chain.spatial_holes_fill = 5; // 5 = fill all the zero pixels
+    rs2::fused_filter_chain post_processing(chain);
     // Spatially align all streams to depth viewport
     // We do this because:
     //   a. Usually depth has wider FOV, and we only really need depth for this demo
@@ -142,7 +145,16 @@ int main(int argc, char * argv[]) try
     // For the color stream, set format to RGBA
     // To allow blending of the color frame on top of the depth frame
     cfg.enable_stream(RS2_STREAM_COLOR, RS2_FORMAT_RGBA8);
-    auto profile = pipe.start(cfg);
+    // The pipeline hands every frameset over to the video-processing thread as soon as it is ready.
+    // The handoff keeps only the newest frameset, and lets the thread sleep between framesets
+    // while still picking them up within microseconds
+    rs2::frame_handoff camera_frames;
+    // Gaps in the frame numbers received from the pipeline account for the frames dropped inside the SDK
+    rs2::stream_statistics pipeline_stats;
+    auto profile = pipe.start(cfg, [camera_frames, pipeline_stats](rs2::frame f) {
+        pipeline_stats.record_arrival(f);
+        camera_frames.enqueue(f);
+    });
 
     auto sensor = profile.get_device().first<rs2::depth_sensor>();
 
@@ -163,48 +175,47 @@ int main(int argc, char * argv[]) try
     app_state.ruler_end   = { 0.55f, 0.5f };
     register_glfw_callbacks(app, app_state);
 
-    // After initial post-processing, frames will flow into this queue:
-    rs2::frame_queue postprocessed_frames;
+    // After initial post-processing, frames will flow into this queue.
+    // The ring queue hands frames over without locking and keeps only the newest frameset,
+    // counting the framesets the main thread did not get to display
+    rs2::frame_ring_queue postprocessed_frames(1, rs2::overflow_policy::drop_oldest);
 
     // Alive boolean will signal the worker threads to finish-up
     std::atomic_bool alive{ true };
 
-    // Video-processing thread will fetch frames from the camera,
-    // apply post-processing and send the result to the main thread for rendering
+    // Post-processing runs as a pipeline of stages, each on its own worker thread,
+    // so that throughput is bound by the slowest stage rather than by the sum of all of them.
+    // Frames leave the graph in the order they entered it; when a stage falls behind
+    // the oldest frame waiting for it is dropped to keep latency bounded
+    rs2::filter_graph post_processing_graph;
+    // First make the frames spatially aligned
+    post_processing_graph.add_stage({ align_to });
+    // Decimation will reduce the resultion of the depth image,
+    // closing small holes and speeding-up the algorithm.
+    // To make sure far-away objects are filtered proportionally
+    // spatial and temporal filtering run in disparity domain,
+    // and the result is switched back to depth
+    post_processing_graph.add_stage({ post_processing });
+    // Apply color map for visualization of depth
+    post_processing_graph.add_stage({ color_map });
+    // When the graph falls behind, new framesets are turned away at its entrance while two are still in flight,
+    // so the expensive alignment is not spent on frames that a later stage would drop anyway
+    post_processing_graph.set_admission_limit(2);
+    // Send resulting frames for visualization in the main thread
+    post_processing_graph.start(postprocessed_frames);
+
+    // Video-processing thread will fetch frames from the camera
+    // and send them to the post-processing graph
     // It recieves synchronized (but not spatially aligned) pairs
-    // and outputs synchronized and aligned pairs
+    // and the graph outputs synchronized and aligned pairs
     std::thread video_processing_thread([&]() {
         while (alive)
         {
-            // Fetch frames from the pipeline and send them for processing
+            // Wait for frames from the pipeline and send them for processing
             rs2::frameset data;
-            if (pipe.poll_for_frames(&data))
+            if (camera_frames.try_wait_for_frame(&data, 100))
             {
-                // First make the frames spatially aligned
-                data = data.apply_filter(align_to);
-
-                // Decimation will reduce the resultion of the depth image,
-                // closing small holes and speeding-up the algorithm
-                data = data.apply_filter(dec);
-
-                // To make sure far-away objects are filtered proportionally
-                // we try to switch to disparity domain
-                data = data.apply_filter(depth2disparity);
-
-                // Apply spatial filtering
-                data = data.apply_filter(spat);
-
-                // Apply temporal filtering
-                data = data.apply_filter(temp);
-
-                // If we are in disparity domain, switch back to depth
-                data = data.apply_filter(disparity2depth);
-
-                //// Apply color map for visualization of depth
-                data = data.apply_filter(color_map);
-
-                // Send resulting frames for visualization in the main thread
-                postprocessed_frames.enqueue(data);
+                post_processing_graph.invoke(data);
             }
         }
     });
@@ -242,11 +253,24 @@ int main(int argc, char * argv[]) try
             glColor3f(1.f, 1.f, 1.f);
             glDisable(GL_BLEND);
         }
+
+        // Report where frames were dropped, from the camera to the screen
+        std::stringstream drops;
+        uint64_t sdk_drops = 0;
+        for (auto&& s : pipeline_stats.get_snapshot())
+            sdk_drops += s.drops;
+        drops << "Dropped: SDK " << sdk_drops << ", handoff " << camera_frames.get_statistics().dropped << ", graph entrance " << post_processing_graph.get_input_statistics().dropped;
+        const char* stage_names[] = { "align", "filters", "colorize" };
+        for (size_t i = 0; i < post_processing_graph.stages(); ++i)
+            drops << ", " << stage_names[i] << " " << post_processing_graph.get_statistics(i).dropped;
+        drops << ", display " << postprocessed_frames.get_statistics().dropped;
+        draw_text(10, 20, drops.str().c_str());
     }
 
     // Signal threads to finish and wait until they do
     alive = false;
     video_processing_thread.join();
+    post_processing_graph.stop();
 
     return EXIT_SUCCESS;
 }
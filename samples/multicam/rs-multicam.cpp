@@ -3,12 +3,40 @@
 
 #include <librealsense2/rs.hpp>     // Include RealSense Cross Platform API
 #include "example.hpp"              // Include short list of convenience functions for rendering
+#include <librealsense2/hpp/rs_executor.hpp>
+#include <librealsense2/hpp/rs_filter_graph.hpp>
+#include <librealsense2/hpp/rs_multiplexer.hpp>
+#include <librealsense2/hpp/rs_cloud_fusion.hpp>
 
 #include <map>
+#include <memory>
 #include <vector>
+#include <cstring>
+#include <fstream>
+
+// Load the pose of every camera in the world from a text file. Every line holds a serial number,
+// a 3x3 rotation written row by row and a translation in meters
+bool load_extrinsics(const char* filename, rs2::point_cloud_fusion& fusion);
+void draw_fused_cloud(float width, float height, glfw_state& app_state, const std::vector<rs2::vertex>& points);
 
 int main(int argc, char * argv[]) try
 {
+    // With --sync only frames captured within a few milliseconds of each other on all cameras are shown together.
+    // With --fuse <file> the depth of all cameras is fused into a single point cloud, using the camera poses in the file
+    bool sync = false;
+    bool fuse = false;
+    rs2::point_cloud_fusion fusion(0.005f);  // 5mm voxels
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--sync")) sync = true;
+        if (!strcmp(argv[i], "--fuse") && i + 1 < argc)
+        {
+            if (!load_extrinsics(argv[++i], fusion))
+                throw std::runtime_error(std::string("Failed to read camera poses from ") + argv[i]);
+            fuse = sync = true;
+        }
+    }
+
     // Create a simple OpenGL window for rendering:
     window app(1280, 960, "CPP Multi-Camera Example");
 
@@ -18,54 +46,112 @@ int main(int argc, char * argv[]) try
 
     std::vector<rs2::pipeline>            pipelines;
 
+    // Processed frames of all cameras meet in the multiplexer, which wakes the main loop as soon as any camera delivers.
+    // Bundles hold one frameset per camera, with timestamps no more than 10 milliseconds apart
+    rs2::frame_multiplexer processed_frames(10.);
+
+    // Processing of every camera runs on the process-wide executor, so the number of processing threads
+    // matches the number of cores however many cameras are attached
+    std::vector<std::unique_ptr<rs2::filter_graph>> graphs;
+
     // Capture serial numbers before opening streaming
     std::vector<std::string>              serials;
     for (auto&& dev : ctx.query_devices())
+    {
         serials.push_back(dev.get_info(RS2_CAMERA_INFO_SERIAL_NUMBER));
 
+        // Bundling compares timestamps of different cameras, which is only meaningful on the shared host clock
+        if (sync)
+            for (auto&& sensor : dev.query_sensors())
+                if (sensor.supports(RS2_OPTION_GLOBAL_TIME_ENABLED))
+                    sensor.set_option(RS2_OPTION_GLOBAL_TIME_ENABLED, 1.f);
+    }
+
     // Start a streaming pipe per each connected device
     for (auto&& serial : serials)
     {
         rs2::pipeline pipe(ctx);
         rs2::config cfg;
         cfg.enable_device(serial);
-        pipe.start(cfg);
-        pipelines.emplace_back(pipe);
+
+        if (fuse)
+        {
+            // Fusion needs the raw depth, so frames go straight from the device to the multiplexer
+            cfg.enable_stream(RS2_STREAM_DEPTH);
+            processed_frames.start(pipe, cfg);
+            pipelines.emplace_back(pipe);
+            continue;
+        }
+
         // Map from each device's serial number to a different colorizer
         colorizers[serial] = rs2::colorizer();
+
+        // The colorizer of the device runs as a task of the shared executor.
+        // The first device is treated as the primary camera and its frames are processed first
+        auto priority = graphs.empty() ? rs2::executor::priority::high : rs2::executor::priority::normal;
+        graphs.emplace_back(new rs2::filter_graph(2));
+        auto& graph = *graphs.back();
+        graph.add_stage({ colorizers[serial] });
+        const size_t source = processed_frames.add_source();
+        graph.start([&processed_frames, source](rs2::frame f) { processed_frames.push(source, f); },
+            rs2::executor::instance(), priority);
+
+        // Frames are delivered to the callback as they arrive and handed to the device's graph
+        pipe.start(cfg, [&graph](rs2::frame f) { graph.invoke(f); });
+        pipelines.emplace_back(pipe);
     }
 
     // We'll keep track of the last frame of each stream available to make the presentation persistent
     std::map<int, rs2::frame> render_frames;
 
+    // State of the point cloud view, rotated and zoomed with the mouse
+    glfw_state app_state;
+    if (fuse)
+        register_glfw_callbacks(app, app_state);
+
     // Main app loop
+    std::vector<rs2::frame> arrived;
     while (app)
     {
-        // Collect the new frames from all the connected devices
-        std::vector<rs2::frame> new_frames;
-        for (auto &&pipe : pipelines)
+        if (fuse)
         {
-            rs2::frameset fs;
-            if (pipe.poll_for_frames(&fs))
-            {
-                for (const rs2::frame& f : fs)
-                    new_frames.emplace_back(f);
-            }
+            // Deprojection and merging of all cameras are spread over all the cores
+            if (processed_frames.try_wait_for_bundle(arrived, 100))
+                fusion.fuse(arrived);
+            draw_fused_cloud(app.width(), app.height(), app_state, fusion.get_points());
+            continue;
         }
 
-        // Convert the newly-arrived frames to render-friendly format
-        for (const auto& frame : new_frames)
+        // Sleep until frames arrive, already colorized by their device's colorizer. The timeout keeps the window responsive
+        // when no camera is streaming
+        bool ready = sync ? processed_frames.try_wait_for_bundle(arrived, 100)
+            : processed_frames.try_wait_for_frames(arrived, 100);
+        if (ready)
         {
-            // Get the serial number of the current frame's device
-            auto serial = rs2::sensor_from_frame(frame)->get_info(RS2_CAMERA_INFO_SERIAL_NUMBER);
-            // Apply the colorizer of the matching device and store the colorized frame
-            render_frames[frame.get_profile().unique_id()] = colorizers[serial].process(frame);
+            for (auto&& f : arrived)
+            {
+                if (auto fs = f.as<rs2::frameset>())
+                {
+                    for (const rs2::frame& sub : fs)
+                        render_frames[sub.get_profile().unique_id()] = sub;
+                }
+                else
+                {
+                    render_frames[f.get_profile().unique_id()] = f;
+                }
+            }
         }
 
         // Present all the collected frames with openGl mosaic
         app.show(render_frames);
     }
 
+    // Stop the devices before the graphs they feed
+    for (auto&& pipe : pipelines)
+        pipe.stop();
+    for (auto& graph : graphs)
+        graph->stop();
+
     return EXIT_SUCCESS;
 }
 catch (const rs2::error & e)
@@ -78,3 +164,62 @@ catch (const std::exception & e)
     std::cerr << e.what() << std::endl;
     return EXIT_FAILURE;
 }
+
+bool load_extrinsics(const char* filename, rs2::point_cloud_fusion& fusion)
+{
+    std::ifstream file(filename);
+    if (!file) return false;
+
+    std::string serial;
+    float r[9];
+    rs2_extrinsics e;
+    while (file >> serial >> r[0] >> r[1] >> r[2] >> r[3] >> r[4] >> r[5] >> r[6] >> r[7] >> r[8]
+        >> e.translation[0] >> e.translation[1] >> e.translation[2])
+    {
+        // rs2_extrinsics holds the rotation column by column
+        for (int row = 0; row < 3; ++row)
+            for (int col = 0; col < 3; ++col)
+                e.rotation[col * 3 + row] = r[row * 3 + col];
+        fusion.set_extrinsics(serial, e);
+    }
+    return file.eof();
+}
+
+// Handles all the OpenGL calls needed to display the fused point cloud, colored by height
+void draw_fused_cloud(float width, float height, glfw_state& app_state, const std::vector<rs2::vertex>& points)
+{
+    glLoadIdentity();
+    glPushAttrib(GL_ALL_ATTRIB_BITS);
+
+    glClearColor(153.f / 255, 153.f / 255, 153.f / 255, 1);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    gluPerspective(60, width / height, 0.01f, 20.0f);
+
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    gluLookAt(0, 0, 0, 0, 0, 1, 0, -1, 0);
+
+    glTranslatef(0, 0, +0.5f + app_state.offset_y * 0.05f);
+    glRotated(app_state.pitch, 1, 0, 0);
+    glRotated(app_state.yaw, 0, 1, 0);
+    glTranslatef(0, 0, -0.5f);
+
+    glPointSize(width / 640);
+    glEnable(GL_DEPTH_TEST);
+    glBegin(GL_POINTS);
+    for (auto&& p : points)
+    {
+        float t = std::min(std::max(-p.y * 0.5f + 0.5f, 0.f), 1.f);
+        glColor3f(t, 0.4f, 1.f - t);
+        glVertex3fv(p);
+    }
+    glEnd();
+
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glPopAttrib();
+}
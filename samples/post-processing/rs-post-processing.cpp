@@ -3,6 +3,12 @@
 
 #include <librealsense2/rs.hpp> // Include RealSense Cross Platform API
 #include "example.hpp"          // Include short list of convenience functions for rendering
+#include <librealsense2/hpp/rs_fused_filter.hpp>
+#include <librealsense2/hpp/rs_filter_timing.hpp>
+#include <librealsense2/hpp/rs_latency_controller.hpp>
+#include <librealsense2/hpp/rs_roi_filter.hpp>
+#include <librealsense2/hpp/rs_static_chain.hpp>
+#include <librealsense2/hpp/rs_frame_ring.hpp>
 
 #include <map>
 #include <string>
@@ -36,16 +42,24 @@ class filter_options
 public:
     filter_options(const std::string name, rs2::filter& filter);
     filter_options(filter_options&& other);
+    void set_roi_variant(rs2::filter& roi_filter);
     std::string filter_name;                                   //Friendly name of the filter
     rs2::filter& filter;                                       //The filter in use
     std::map<rs2_option, filter_slider_ui> supported_options;  //maps from an option supported by the filter, to the corresponding slider
     std::atomic_bool is_enabled;                               //A boolean controlled by the user that determines whether to apply the filter or not
+    std::shared_ptr<rs2::instrumented_filter> timing;          //Applies the filter while measuring its processing time and throughput
+    rs2::filter* roi_filter;                                   //Variant of the filter restricted to regions of interest, if there is one
+    std::shared_ptr<rs2::instrumented_filter> roi_timing;      //Applies and measures the variant
 };
 
 // Helper functions for rendering the UI
-void render_ui(float w, float h, std::vector<filter_options>& filters);
+void render_ui(float w, float h, std::vector<filter_options>& filters, std::atomic_bool& use_fused, const rs2::instrumented_filter& fused_timing,
+    std::atomic_bool& use_fixed_point, std::atomic_bool& use_static, const rs2::instrumented_filter& static_timing, std::atomic_bool& use_budget, const rs2::latency_budget_controller& budget, std::atomic_bool& use_roi);
+void render_timing_ui(const float2& location, const rs2::instrumented_filter& timing);
+// Helper function for copying the options a filter shares with its region of interest variant
+void sync_options(const rs2::filter& from, const rs2::filter& to);
 // Helper function for getting data from the queues and updating the view
-void update_data(rs2::frame_queue& data, rs2::frame& depth, rs2::points& points, rs2::pointcloud& pc, glfw_state& view, rs2::colorizer& color_map);
+void update_data(const rs2::frame_ring_queue& data, rs2::frame& depth, rs2::points& points, rs2::pointcloud& pc, glfw_state& view, rs2::colorizer& color_map);
 
 int main(int argc, char * argv[]) try
 {
@@ -90,9 +104,53 @@ int main(int argc, char * argv[]) try
     filters.emplace_back("Spatial", spat_filter);
     filters.emplace_back("Temporal", temp_filter);
 
+    // The spatial and temporal filters also come in a variant that only filters regions of interest, for applications
+    // that track a few objects and do not need the rest of the frame filtered. Their cost scales with the tracked area
+    rs2::roi_spatial_filter roi_spat_filter;
+    rs2::roi_temporal_filter roi_temp_filter;
+    filters[3].set_roi_variant(roi_spat_filter);
+    filters[4].set_roi_variant(roi_temp_filter);
+    std::atomic_bool use_roi(false);
+
+    // The fused chain runs the same stages in a single processing block, without allocating intermediate frames.
+    // It mirrors the options and checkboxes of the filters above, so both paths can be compared side by side
+    rs2::fused_filter_chain fused_chain;
+    std::atomic_bool use_fused(false);
+    std::atomic_bool use_fixed_point(false); // Run the fused chain on 16-bit fixed-point data instead of float
+    rs2::instrumented_filter fused_timing(fused_chain);
+
+    // The same chain can also be composed at compile time. The static chain always runs all of its stages,
+    // calling them directly and keeping intermediate results in its own scratch buffers
+    rs2::static_filter_chain<rs2::chain::decimation, rs2::chain::threshold, rs2::chain::depth_to_disparity,
+        rs2::chain::spatial, rs2::chain::temporal, rs2::chain::disparity_to_depth> static_chain;
+    std::atomic_bool use_static(false);
+    rs2::instrumented_filter static_timing(static_chain);
+
+    // The latency budget controller watches the processing time of the filters and, when they take longer than the budget,
+    // trades quality for speed one step at a time: cheaper holes filling, fewer spatial iterations, stronger decimation,
+    // and finally turning off the spatial and temporal filters. Steps are reverted in reverse order once there is headroom again.
+    // Every change is written to the log, which is printed to the console here
+    rs2::log_to_console(RS2_LOG_SEVERITY_INFO);
+    std::atomic_bool use_budget(false);
+    rs2::latency_budget_controller budget(15.f);
+    for (auto&& filter : filters)
+        budget.add_cost(*filter.timing);
+    budget.add_cost(fused_timing);
+    budget.add_option_step(spat_filter, RS2_OPTION_HOLES_FILL, 0, "Spatial holes fill");
+    budget.add_option_step(spat_filter, RS2_OPTION_FILTER_MAGNITUDE, 1, "Spatial iterations");
+    budget.add_option_step(dec_filter, RS2_OPTION_FILTER_MAGNITUDE, 3, "Decimation magnitude");
+    budget.add_option_step(dec_filter, RS2_OPTION_FILTER_MAGNITUDE, 4, "Decimation magnitude");
+    for (auto&& filter : filters)
+    {
+        if (filter.filter_name == "Spatial" || filter.filter_name == "Temporal")
+            budget.add_stage_toggle(filter.is_enabled, filter.filter_name);
+    }
+
     // Declaring two concurrent queues that will be used to enqueue and dequeue frames from different threads
-    rs2::frame_queue original_data;
-    rs2::frame_queue filtered_data;
+    // The ring queues never block the processing thread: when the UI falls behind, the oldest frame is dropped.
+    // Their statistics show how many frames were dropped and how long frames waited for the UI
+    rs2::frame_ring_queue original_data(1, rs2::overflow_policy::drop_oldest);
+    rs2::frame_ring_queue filtered_data(1, rs2::overflow_policy::drop_oldest);
 
     // Declare depth colorizer for pretty visualization of depth data
     rs2::colorizer color_map;
@@ -112,6 +170,55 @@ int main(int argc, char * argv[]) try
 
             rs2::frame filtered = depth_frame; // Does not copy the frame, only adds a reference
 
+            if (use_fused)
+            {
+                rs2::depth_chain_settings settings;
+                settings.read_from(dec_filter, thr_filter, spat_filter, temp_filter);
+                for (auto&& filter : filters)
+                {
+                    if (filter.filter_name == "Decimate") settings.decimation = filter.is_enabled;
+                    else if (filter.filter_name == "Threshold") settings.threshold = filter.is_enabled;
+                    else if (filter.filter_name == disparity_filter_name) settings.disparity = filter.is_enabled;
+                    else if (filter.filter_name == "Spatial") settings.spatial = filter.is_enabled;
+                    else if (filter.filter_name == "Temporal") settings.temporal = filter.is_enabled;
+                }
+                settings.fixed_point = use_fixed_point;
+                fused_chain.set_settings(settings);
+
+                filtered_data.enqueue(fused_timing.process(filtered));
+                original_data.enqueue(depth_frame);
+                if (use_budget)
+                    budget.update();
+                continue;
+            }
+
+            if (use_static)
+            {
+                // Mirror the options of the filters above
+                rs2::depth_chain_settings settings;
+                settings.read_from(dec_filter, thr_filter, spat_filter, temp_filter);
+                static_chain.configure<rs2::chain::decimation>([&](rs2::chain::decimation& s) { s.magnitude = settings.decimation_magnitude; });
+                static_chain.configure<rs2::chain::threshold>([&](rs2::chain::threshold& s) {
+                    s.min_distance = settings.min_distance;
+                    s.max_distance = settings.max_distance;
+                });
+                static_chain.configure<rs2::chain::spatial>([&](rs2::chain::spatial& s) {
+                    s.iterations = settings.spatial_iterations;
+                    s.alpha = settings.spatial_alpha;
+                    s.delta = settings.spatial_delta;
+                    s.holes_fill = settings.spatial_holes_fill;
+                });
+                static_chain.configure<rs2::chain::temporal>([&](rs2::chain::temporal& s) {
+                    s.alpha = settings.temporal_alpha;
+                    s.delta = settings.temporal_delta;
+                    s.persistence = settings.temporal_persistence;
+                });
+
+                filtered_data.enqueue(static_timing.process(filtered));
+                original_data.enqueue(depth_frame);
+                continue;
+            }
+
             /* Apply filters.
             The implemented flow of the filters pipeline is in the following order:
             1. apply decimation filter
@@ -127,7 +234,23 @@ int main(int argc, char * argv[]) try
             {
                 if (filter.is_enabled)
                 {
-                    filtered = filter.filter.process(filtered);
+                    if (use_roi && filter.roi_filter)
+                    {
+                        // A tracker or detector would provide the regions; this sample uses the central quarter of the frame.
+                        // Regions are in pixels of the frame entering the filter, i.e. after decimation
+                        auto frame = filtered.as<rs2::video_frame>();
+                        const int w = frame.get_width(), h = frame.get_height();
+                        std::vector<rs2::region_of_interest> regions{ { w / 4, h / 4, w * 3 / 4 - 1, h * 3 / 4 - 1 } };
+                        roi_spat_filter.set_regions(regions);
+                        roi_temp_filter.set_regions(regions);
+
+                        sync_options(filter.filter, *filter.roi_filter);
+                        filtered = filter.roi_timing->process(filtered);
+                    }
+                    else
+                    {
+                        filtered = filter.timing->process(filtered);
+                    }
                     if (filter.filter_name == disparity_filter_name)
                     {
                         revert_disparity = true;
@@ -146,6 +269,10 @@ int main(int argc, char * argv[]) try
             //  synchronization mechanisms
             filtered_data.enqueue(filtered);
             original_data.enqueue(depth_frame);
+
+            // Let the controller react to the time the filters took on this frame
+            if (use_budget)
+                budget.update();
         }
     });
 
@@ -171,7 +298,7 @@ int main(int argc, char * argv[]) try
         float h = static_cast<float>(app.height());
 
         // Render the GUI
-        render_ui(w, h, filters);
+        render_ui(w, h, filters, use_fused, fused_timing, use_fixed_point, use_static, static_timing, use_budget, budget, use_roi);
 
         // Try to get new data from the queues and update the view with new texture
         update_data(original_data, colored_depth, original_points, original_pc, original_view_orientation, color_map);
@@ -180,6 +307,12 @@ int main(int argc, char * argv[]) try
         draw_text(10, 50, "Original");
         draw_text(static_cast<int>(w / 2), 50, "Filtered");
 
+        // Show what happens in the handoff between the processing thread and the UI
+        auto handoff = filtered_data.get_statistics();
+        std::string handoff_text = "Queue: dropped " + std::to_string(handoff.dropped) +
+            ", waited " + std::to_string(static_cast<int>(handoff.age_mean_ms + 0.5f)) + " ms on average";
+        draw_text(static_cast<int>(w / 2), 70, handoff_text.c_str());
+
         // Draw the pointclouds of the original and the filtered frames (if the are available already)
         if (colored_depth && original_points)
         {
@@ -229,7 +362,7 @@ catch (const std::exception& e)
     return EXIT_FAILURE;
 }
 
-void update_data(rs2::frame_queue& data, rs2::frame& colorized_depth, rs2::points& points, rs2::pointcloud& pc, glfw_state& view, rs2::colorizer& color_map)
+void update_data(const rs2::frame_ring_queue& data, rs2::frame& colorized_depth, rs2::points& points, rs2::pointcloud& pc, glfw_state& view, rs2::colorizer& color_map)
 {
     rs2::frame f;
     if (data.poll_for_frame(&f))  // Try to take the depth and points from the queue
@@ -241,7 +374,8 @@ void update_data(rs2::frame_queue& data, rs2::frame& colorized_depth, rs2::point
     }
 }
 
-void render_ui(float w, float h, std::vector<filter_options>& filters)
+void render_ui(float w, float h, std::vector<filter_options>& filters, std::atomic_bool& use_fused, const rs2::instrumented_filter& fused_timing,
+    std::atomic_bool& use_fixed_point, std::atomic_bool& use_static, const rs2::instrumented_filter& static_timing, std::atomic_bool& use_budget, const rs2::latency_budget_controller& budget, std::atomic_bool& use_roi)
 {
     // Flags for displaying ImGui window
     static const int flags = ImGuiWindowFlags_NoCollapse
@@ -270,6 +404,9 @@ void render_ui(float w, float h, std::vector<filter_options>& filters)
         filter.is_enabled = tmp_value;
         ImGui::PopStyleColor();
 
+        // Show what the filter costs below its checkbox
+        render_timing_ui({ offset_x, offset_y + 22 }, (use_roi && filter.roi_timing) ? *filter.roi_timing : *filter.timing);
+
         if (filter.supported_options.size() == 0)
         {
             offset_y += elements_margin;
@@ -278,6 +415,8 @@ void render_ui(float w, float h, std::vector<filter_options>& filters)
         for (auto& option_slider_pair : filter.supported_options)
         {
             filter_slider_ui& slider = option_slider_pair.second;
+            // The latency budget controller may have changed the option behind the slider's back
+            slider.value = filter.filter.get_option(option_slider_pair.first);
             if (slider.render({ offset_x + offset_from_checkbox, offset_y, w / 4 }, filter.is_enabled))
             {
                 filter.filter.set_option(option_slider_pair.first, slider.value);
@@ -286,10 +425,86 @@ void render_ui(float w, float h, std::vector<filter_options>& filters)
         }
     }
 
+    // Draw a checkbox to switch between the filters above and the fused chain
+    ImGui::SetCursorPos({ offset_x, offset_y });
+    ImGui::PushStyleColor(ImGuiCol_CheckMark, { 40 / 255.f, 170 / 255.f, 90 / 255.f, 1 });
+    bool fused = use_fused;
+    ImGui::Checkbox("Fused chain", &fused);
+    if (ImGui::IsItemHovered())
+        ImGui::SetTooltip("Run the enabled filters as a single fused processing block");
+    use_fused = fused;
+    ImGui::SameLine();
+    bool fixed_point = use_fixed_point;
+    ImGui::Checkbox("16-bit", &fixed_point);
+    if (ImGui::IsItemHovered())
+        ImGui::SetTooltip("Keep the fused chain's working data in 16-bit fixed point, halving its memory traffic");
+    use_fixed_point = fixed_point;
+    ImGui::PopStyleColor();
+    render_timing_ui({ offset_x, offset_y + 22 }, fused_timing);
+    offset_y += elements_margin;
+
+    // Draw a checkbox to switch to the chain composed at compile time
+    ImGui::SetCursorPos({ offset_x, offset_y });
+    ImGui::PushStyleColor(ImGuiCol_CheckMark, { 40 / 255.f, 170 / 255.f, 90 / 255.f, 1 });
+    bool static_chain = use_static;
+    ImGui::Checkbox("Static chain", &static_chain);
+    if (ImGui::IsItemHovered())
+        ImGui::SetTooltip("Run all filters as a chain composed at compile time (checkboxes are ignored)");
+    use_static = static_chain;
+    ImGui::PopStyleColor();
+    render_timing_ui({ offset_x, offset_y + 22 }, static_timing);
+    offset_y += elements_margin;
+
+    // Draw a checkbox to let the latency budget controller adjust the filters
+    ImGui::SetCursorPos({ offset_x, offset_y });
+    ImGui::PushStyleColor(ImGuiCol_CheckMark, { 40 / 255.f, 170 / 255.f, 90 / 255.f, 1 });
+    bool limited = use_budget;
+    ImGui::Checkbox("Latency budget", &limited);
+    if (ImGui::IsItemHovered())
+        ImGui::SetTooltip("Lower the filters' quality while they take longer than %.0f ms per frame", budget.budget());
+    use_budget = limited;
+    ImGui::PopStyleColor();
+    ImGui::SetCursorPos({ offset_x, offset_y + 22 });
+    ImGui::PushStyleColor(ImGuiCol_Text, { 0.6f, 0.6f, 0.6f, 1 });
+    ImGui::Text("%.2f ms, level %d", budget.smoothed_cost(), int(budget.level()));
+    ImGui::PopStyleColor();
+    offset_y += elements_margin;
+
+    // Draw a checkbox to restrict the spatial and temporal filters to regions of interest
+    ImGui::SetCursorPos({ offset_x, offset_y });
+    ImGui::PushStyleColor(ImGuiCol_CheckMark, { 40 / 255.f, 170 / 255.f, 90 / 255.f, 1 });
+    bool roi = use_roi;
+    ImGui::Checkbox("Regions of interest", &roi);
+    if (ImGui::IsItemHovered())
+        ImGui::SetTooltip("Apply the spatial and temporal filters only to the center of the frame");
+    use_roi = roi;
+    ImGui::PopStyleColor();
+
     ImGui::End();
     ImGui::Render();
 }
 
+/**
+  Helper function for rendering the processing time of a filter, with throughput counters in the tooltip
+*/
+void render_timing_ui(const float2& location, const rs2::instrumented_filter& timing)
+{
+    ImGui::SetCursorPos({ location.x, location.y });
+    ImGui::PushStyleColor(ImGuiCol_Text, { 0.6f, 0.6f, 0.6f, 1 });
+    ImGui::Text("%.2f / %.2f / %.2f ms",
+        timing.get_option(rs2::instrumented_filter::OPTION_PROCESSING_TIME_LAST),
+        timing.get_option(rs2::instrumented_filter::OPTION_PROCESSING_TIME_MEAN),
+        timing.get_option(rs2::instrumented_filter::OPTION_PROCESSING_TIME_P99));
+    if (ImGui::IsItemHovered())
+    {
+        ImGui::SetTooltip("Processing time: last / mean / p99\nFrames in: %.0f, out: %.0f, dropped: %.0f",
+            timing.get_option(rs2::instrumented_filter::OPTION_FRAMES_IN),
+            timing.get_option(rs2::instrumented_filter::OPTION_FRAMES_OUT),
+            timing.get_option(rs2::instrumented_filter::OPTION_FRAMES_DROPPED));
+    }
+    ImGui::PopStyleColor();
+}
+
 bool filter_slider_ui::render(const float3& location, bool enabled)
 {
     bool value_changed = false;
@@ -354,7 +569,9 @@ Constructor for filter_options, takes a name and a filter.
 filter_options::filter_options(const std::string name, rs2::filter& flt) :
     filter_name(name),
     filter(flt),
-    is_enabled(true)
+    is_enabled(true),
+    timing(std::make_shared<rs2::instrumented_filter>(flt)),
+    roi_filter(nullptr)
 {
     const std::array<rs2_option, 5> possible_filter_options = {
         RS2_OPTION_FILTER_MAGNITUDE,
@@ -386,6 +603,30 @@ filter_options::filter_options(filter_options&& other) :
     filter_name(std::move(other.filter_name)),
     filter(other.filter),
     supported_options(std::move(other.supported_options)),
-    is_enabled(other.is_enabled.load())
+    is_enabled(other.is_enabled.load()),
+    timing(std::move(other.timing)),
+    roi_filter(other.roi_filter),
+    roi_timing(std::move(other.roi_timing))
+{
+}
+
+/**
+  Register a variant of the filter restricted to regions of interest
+*/
+void filter_options::set_roi_variant(rs2::filter& flt)
 {
+    roi_filter = &flt;
+    roi_timing = std::make_shared<rs2::instrumented_filter>(flt);
+}
+
+/**
+  Helper function for keeping the options of a filter and its region of interest variant the same
+*/
+void sync_options(const rs2::filter& from, const rs2::filter& to)
+{
+    for (auto opt : { RS2_OPTION_FILTER_MAGNITUDE, RS2_OPTION_FILTER_SMOOTH_ALPHA, RS2_OPTION_FILTER_SMOOTH_DELTA, RS2_OPTION_HOLES_FILL })
+    {
+        if (from.supports(opt) && to.supports(opt) && from.get_option(opt) != to.get_option(opt))
+            to.set_option(opt, from.get_option(opt));
+    }
 }
@@ -2,8 +2,13 @@
 // Copyright(c) 2017 Intel Corporation. All Rights Reserved.
 
 #include <librealsense2/rs.hpp> // Include RealSense Cross Platform API
+#include <librealsense2/hpp/rs_batch_playback.hpp>
+#include <librealsense2/hpp/rs_fused_filter.hpp>
+#include <librealsense2/hpp/rs_playback_index.hpp>
+#include <librealsense2/hpp/rs_lz4_recording.hpp>
 #include "example.hpp"          // Include short list of convenience functions for rendering
 #include <chrono>
+#include <cstring>
 
 #include <imgui.h>
 #include "imgui_impl_glfw.h"
@@ -17,10 +22,39 @@
 // Helper function for dispaying time conveniently
 std::string pretty_time(std::chrono::nanoseconds duration);
 // Helper function for rendering a seek bar
-void draw_seek_bar(rs2::playback& playback, int* seek_pos, float2& location, float width);
+void draw_seek_bar(rs2::playback& playback, rs2::playback_scrubber& scrubber, int* seek_pos, float2& location, float width);
+// Headless reprocessing of every recording in a directory
+int run_batch(const std::string& directory, size_t jobs);
+// Compressed recording of every connected camera, and its playback
+int record_compressed(const std::string& prefix, int level, int seconds, bool use_depth_codec);
+int play_compressed(const std::string& file);
 
 int main(int argc, char * argv[]) try
 {
+    // rs-record-playback --batch <directory> [--jobs <n>] processes recordings without opening a window
+    // rs-record-playback --record-lz4 <prefix> [--level <n>] [--seconds <n>] [--lz4-depth] records compressed, --play-lz4 <file> plays it
+    std::string batch_directory, record_prefix, play_file;
+    size_t jobs = 0;
+    int level = 0, seconds = 10;
+    bool use_depth_codec = true;
+    for (int i = 1; i < argc; ++i)
+        if (!strcmp(argv[i], "--lz4-depth")) use_depth_codec = false;
+    for (int i = 1; i + 1 < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--batch")) batch_directory = argv[++i];
+        else if (!strcmp(argv[i], "--jobs")) jobs = size_t(std::atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--record-lz4")) record_prefix = argv[++i];
+        else if (!strcmp(argv[i], "--level")) level = std::atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--seconds")) seconds = std::atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--play-lz4")) play_file = argv[++i];
+    }
+    if (!batch_directory.empty())
+        return run_batch(batch_directory, jobs);
+    if (!record_prefix.empty())
+        return record_compressed(record_prefix, level, seconds, use_depth_codec);
+    if (!play_file.empty())
+        return play_compressed(play_file);
+
     // Create a simple OpenGL window for rendering:
     window app(1280, 720, "RealSense Record and Playback Example");
     ImGui_ImplGlfw_Init(app, false);
@@ -51,6 +85,9 @@ int main(int argc, char * argv[]) try
     // Create a variable to control the seek bar
     int seek_pos;
 
+    // Seeks the playback in the background, so dragging the seek bar does not stall the window
+    std::unique_ptr<rs2::playback_scrubber> scrubber;
+
     // While application is running
     while(app) {
         // Flags for displaying ImGui window
@@ -150,6 +187,8 @@ int main(int argc, char * argv[]) try
                     cfg.enable_device_from_file("a.bag");
                     pipe->start(cfg); //File will be opened in read mode at this point
                     device = pipe->get_active_profile().get_device();
+                    // Loads a.bag.idx in the background, or indexes the recording if it has no index yet
+                    scrubber.reset(new rs2::playback_scrubber(device.as<rs2::playback>(), "a.bag"));
                 }
                 else
                 {
@@ -169,7 +208,7 @@ int main(int argc, char * argv[]) try
 
             // Render a seek bar for the player
             float2 location = { app.width() / 4, 4 * app.height() / 5 + 110 };
-            draw_seek_bar(playback , &seek_pos, location, app.width() / 2);
+            draw_seek_bar(playback, *scrubber, &seek_pos, location, app.width() / 2);
 
             ImGui::SetCursorPos({ app.width() / 2, 4 * app.height() / 5 + 50 });
             if (ImGui::Button(" pause\nplaying", { 50, 50 }))
@@ -180,6 +219,7 @@ int main(int argc, char * argv[]) try
             ImGui::SetCursorPos({ app.width() / 2 + 100, 4 * app.height() / 5 + 50 });
             if (ImGui::Button("  stop\nplaying", { 50, 50 }))
             {
+                scrubber.reset();
                 pipe->stop();
                 pipe = std::make_shared<rs2::pipeline>();
                 pipe->start();
@@ -229,25 +269,138 @@ std::string pretty_time(std::chrono::nanoseconds duration)
 }
 
 
-void draw_seek_bar(rs2::playback& playback, int* seek_pos, float2& location, float width)
+int run_batch(const std::string& directory, size_t jobs)
+{
+    auto files = rs2::batch_playback::list_recordings(directory);
+    if (files.empty())
+    {
+        std::cerr << "No .bag files in " << directory << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Every file gets its own processing chain, created on the thread that processes the file
+    auto make_handler = [](const std::string&) {
+        auto chain = std::make_shared<rs2::fused_filter_chain>();
+        auto pc = std::make_shared<rs2::pointcloud>();
+        return [chain, pc](rs2::frame f) {
+            if (auto depth = f.as<rs2::depth_frame>())
+                pc->calculate(chain->process(depth));
+        };
+    };
+
+    auto started = std::chrono::steady_clock::now();
+    auto results = rs2::batch_playback(jobs).run(files, make_handler);
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    uint64_t frames = 0;
+    double recorded = 0;
+    int failed = 0;
+    std::cout << std::fixed << std::setprecision(1);
+    for (auto& r : results)
+    {
+        std::cout << r.file << ": ";
+        if (!r.error.empty())
+        {
+            std::cout << "failed, " << r.error << std::endl;
+            ++failed;
+            continue;
+        }
+        std::cout << r.frames << " frames in " << r.seconds << " s, " << r.frames / std::max(r.seconds, 1e-6) << " fps, "
+            << r.recorded_seconds / std::max(r.seconds, 1e-6) << "x real time" << std::endl;
+        frames += r.frames;
+        recorded += r.recorded_seconds;
+    }
+    std::cout << "Total: " << results.size() - failed << " of " << results.size() << " files, " << frames << " frames in " << wall << " s, "
+        << frames / std::max(wall, 1e-6) << " fps, " << recorded / std::max(wall, 1e-6) << "x real time" << std::endl;
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+
+int record_compressed(const std::string& prefix, int level, int seconds, bool use_depth_codec)
+{
+    // One pipeline and one recording per camera. All recordings compress on the shared executor
+    rs2::context ctx;
+    std::vector<rs2::pipeline> pipes;
+    std::vector<rs2::lz4_recorder> recorders;
+    std::vector<std::string> files;
+    for (auto&& dev : ctx.query_devices())
+    {
+        std::string serial = dev.get_info(RS2_CAMERA_INFO_SERIAL_NUMBER);
+        files.push_back(prefix + "-" + serial + ".rsz");
+        rs2::lz4_recorder recorder(files.back(), level, use_depth_codec);
+        rs2::config cfg;
+        cfg.enable_device(serial);
+        cfg.enable_stream(RS2_STREAM_DEPTH);
+        cfg.enable_stream(RS2_STREAM_COLOR);
+        rs2::pipeline pipe(ctx);
+        pipe.start(cfg, recorder);
+        pipes.push_back(pipe);
+        recorders.push_back(recorder);
+    }
+    if (pipes.empty())
+    {
+        std::cerr << "No device connected" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    for (auto& pipe : pipes) pipe.stop();
+
+    std::cout << std::fixed << std::setprecision(1);
+    for (size_t i = 0; i < recorders.size(); ++i)
+    {
+        recorders[i].close();
+        auto stats = recorders[i].get_statistics();
+        std::cout << files[i] << ": " << stats.frames << " frames, " << stats.dropped << " dropped, "
+            << stats.raw_bytes / 1e6 / seconds << " MB/s raw, " << stats.stored_bytes / 1e6 / seconds << " MB/s written, ratio "
+            << double(stats.raw_bytes) / std::max<uint64_t>(stats.stored_bytes, 1) << std::endl;
+    }
+    return EXIT_SUCCESS;
+}
+
+int play_compressed(const std::string& file)
+{
+    window app(1280, 720, "RealSense Record and Playback Example");
+    texture depth_image;
+    rs2::colorizer color_map;
+
+    // The recording plays through a software device, matched into framesets like the frames of a camera
+    rs2::lz4_playback player(file);
+    rs2::syncer sync;
+    player.start(sync);
+
+    rs2::frame depth;
+    while (app && !player.finished())
+    {
+        rs2::frameset frames;
+        if (sync.poll_for_frames(&frames) && frames.get_depth_frame())
+            depth = color_map.process(frames.get_depth_frame());
+        depth_image.render(depth, { app.width() * 0.25f, app.height() * 0.25f, app.width() * 0.5f, app.height() * 0.75f });
+    }
+    player.stop();
+    return EXIT_SUCCESS;
+}
+
+
+void draw_seek_bar(rs2::playback& playback, rs2::playback_scrubber& scrubber, int* seek_pos, float2& location, float width)
 {
+    // The slider has a step per pixel, the index snaps it to the nearest frame
+    const int steps = std::max(100, static_cast<int>(width));
     int64_t playback_total_duration = playback.get_duration().count();
-    auto progress = playback.get_position();
+    auto progress = scrubber.position().count();
     double part = (1.0 * progress) / playback_total_duration;
-    *seek_pos = static_cast<int>(std::max(0.0, std::min(part, 1.0)) * 100);
+    *seek_pos = static_cast<int>(std::max(0.0, std::min(part, 1.0)) * steps);
     auto playback_status = playback.current_status();
     ImGui::PushItemWidth(width);
     ImGui::SetCursorPos({ location.x, location.y });
     ImGui::PushStyleVar(ImGuiStyleVar_FrameRounding, 12);
-    if (ImGui::SliderInt("##seek bar", seek_pos, 0, 100, "", true))
+    if (ImGui::SliderInt("##seek bar", seek_pos, 0, steps, "", true))
     {
         //Seek was dragged
         if (playback_status != RS2_PLAYBACK_STATUS_STOPPED) //Ignore seek when playback is stopped
         {
-            auto duration_db = std::chrono::duration_cast<std::chrono::duration<double, std::nano>>(playback.get_duration());
-            auto single_percent = duration_db.count() / 100;
-            auto seek_time = std::chrono::duration<double, std::nano>((*seek_pos) * single_percent);
-            playback.seek(std::chrono::duration_cast<std::chrono::nanoseconds>(seek_time));
+            auto seek_time = std::chrono::duration<double, std::nano>(double(*seek_pos) * playback_total_duration / steps);
+            scrubber.seek(std::chrono::duration_cast<std::chrono::nanoseconds>(seek_time)); // Returns immediately, the seek runs in the background
         }
     }
     std::string time_elapsed = pretty_time(std::chrono::nanoseconds(progress));
@@ -0,0 +1,88 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+// Copyright(c) 2017 Intel Corporation. All Rights Reserved.
+
+// Windows implementation of the platform calls declared in librealsense2/hpp/rs_platform.hpp.
+// <windows.h> is only included here, so applications using the SDK headers are free to configure it as they like.
+// Compiles to nothing on other platforms, where the header defines the calls inline.
+
+#ifdef _WIN32
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <librealsense2/hpp/rs_platform.hpp>
+
+namespace rs2
+{
+    namespace platform
+    {
+        bool set_thread_affinity(const std::vector<int>& cpus)
+        {
+            DWORD_PTR mask = 0;
+            for (int cpu : cpus)
+                if (cpu >= 0 && cpu < int(sizeof(mask) * 8)) mask |= DWORD_PTR(1) << cpu;
+            return mask && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+        }
+
+        bool set_thread_realtime(int)
+        {
+            return SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) != 0;
+        }
+
+        bool set_thread_name(const std::string& name)
+        {
+            // SetThreadDescription is only available since Windows 10 1607
+            typedef HRESULT(WINAPI *set_description)(HANDLE, PCWSTR);
+            auto f = reinterpret_cast<set_description>(GetProcAddress(GetModuleHandleA("kernel32.dll"), "SetThreadDescription"));
+            if (!f) return false;
+            std::wstring wide(name.begin(), name.end());
+            return SUCCEEDED(f(GetCurrentThread(), wide.c_str()));
+        }
+
+        size_t page_size()
+        {
+            SYSTEM_INFO info;
+            GetSystemInfo(&info);
+            return info.dwPageSize;
+        }
+
+        mapped_file::~mapped_file()
+        {
+            if (_view) UnmapViewOfFile(_view);
+            if (_mapping) CloseHandle(_mapping);
+            if (_file) CloseHandle(_file);
+        }
+
+        void mapped_file::map(const std::string& path, uint64_t create_size, bool writable)
+        {
+            HANDLE file = CreateFileA(path.c_str(), writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ, FILE_SHARE_READ, nullptr,
+                writable ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE) throw std::runtime_error("Failed to open " + path);
+            _file = file;
+
+            LARGE_INTEGER size;
+            if (writable)
+            {
+                // Extending the end of file allocates its clusters, unlike a sparse file
+                size.QuadPart = LONGLONG(create_size);
+                if (!SetFilePointerEx(file, size, nullptr, FILE_BEGIN) || !SetEndOfFile(file))
+                    throw std::runtime_error("Not enough space to allocate " + path);
+            }
+            else if (!GetFileSizeEx(file, &size))
+                size.QuadPart = 0;
+            _size = uint64_t(size.QuadPart);
+            if (!_size) throw std::runtime_error("Failed to map empty file " + path);
+
+            _mapping = CreateFileMappingA(file, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY, 0, 0, nullptr);
+            if (_mapping) _view = MapViewOfFile(_mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0);
+            if (!_view) throw std::runtime_error("Failed to map " + path);
+            if (writable) touch_pages();
+        }
+    }
+}
+
+#endif
@@ -2,22 +2,49 @@
 // Copyright(c) 2015-2017 Intel Corporation. All Rights Reserved.
 
 #include <librealsense2/rs.hpp> // Include RealSense Cross Platform API
+#include <librealsense2/hpp/rs_capture_ring.hpp>
+#include <librealsense2/hpp/rs_metadata_log.hpp>
 
 #include <fstream>              // File IO
 #include <iostream>             // Terminal IO
 #include <sstream>              // Stringstreams
+#include <cstring>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <algorithm>
 
 // 3rd party header for writing png files
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
 
-// Helper function for writing metadata to disk as a csv file
-void metadata_to_csv(const rs2::frame& frm, const std::string& filename);
+// High-rate capture into a memory-mapped ring file, and its offline conversion to PNG and CSV
+int capture_to_ring(const std::string& file, size_t slots, int seconds);
+int convert_ring(const std::string& file, const std::string& directory);
 
 // This sample captures 30 frames and writes the last frame to disk.
 // It can be useful for debugging an embedded system with no display.
 int main(int argc, char * argv[]) try
 {
+    // rs-save-to-disk --ring <file> [--slots <n>] [--seconds <n>] captures every frame into a ring file,
+    // rs-save-to-disk --convert <file> <directory> turns the frames of a ring file into images,
+    // rs-save-to-disk --metadata-to-csv <file> <csv file> converts a metadata log
+    std::string ring_file;
+    size_t slots = 1024;
+    int seconds = 10;
+    for (int i = 1; i + 1 < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--ring")) ring_file = argv[++i];
+        else if (!strcmp(argv[i], "--slots")) slots = size_t(std::atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--seconds")) seconds = std::atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--convert") && i + 2 < argc) return convert_ring(argv[i + 1], argv[i + 2]);
+        else if (!strcmp(argv[i], "--metadata-to-csv") && i + 2 < argc)
+            return rs2::metadata_log::to_csv(argv[i + 1], argv[i + 2]) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (!ring_file.empty())
+        return capture_to_ring(ring_file, slots, seconds);
+
     // Declare depth colorizer for pretty visualization of depth data
     rs2::colorizer color_map;
 
@@ -26,12 +53,17 @@ int main(int argc, char * argv[]) try
     // Start streaming with default recommended configuration
     pipe.start();
 
+    // Log the metadata of every frame, a binary file per stream
+    rs2::metadata_log metadata("rs-save-to-disk-output-");
+
     // Capture 30 frames to give autoexposure, etc. a chance to settle
-    for (auto i = 0; i < 30; ++i) pipe.wait_for_frames();
+    for (auto i = 0; i < 30; ++i) metadata(pipe.wait_for_frames());
 
     // Wait for the next set of frames from the camera. Now that autoexposure, etc.
     // has settled, we will write these to disk
-    for (auto&& frame : pipe.wait_for_frames())
+    auto frames = pipe.wait_for_frames();
+    metadata(frames);
+    for (auto&& frame : frames)
     {
         // We can only save video frames as pngs, so we skip the rest
         if (auto vf = frame.as<rs2::video_frame>())
@@ -46,15 +78,18 @@ int main(int argc, char * argv[]) try
             stbi_write_png(png_file.str().c_str(), vf.get_width(), vf.get_height(),
                            vf.get_bytes_per_pixel(), vf.get_data(), vf.get_stride_in_bytes());
             std::cout << "Saved " << png_file.str() << std::endl;
-
-            // Record per-frame metadata for UVC streams
-            std::stringstream csv_file;
-            csv_file << "rs-save-to-disk-output-" << vf.get_profile().stream_name()
-                     << "-metadata.csv";
-            metadata_to_csv(vf, csv_file.str());
         }
     }
 
+    // Convert the metadata of all frames to CSV, a row per frame
+    metadata.flush();
+    for (auto& log : metadata.files())
+    {
+        auto csv_file = log.substr(0, log.size() - std::string(".rsmeta").size()) + "-metadata.csv";
+        if (rs2::metadata_log::to_csv(log, csv_file))
+            std::cout << "Saved " << csv_file << std::endl;
+    }
+
     return EXIT_SUCCESS;
 }
 catch(const rs2::error & e)
@@ -68,24 +103,107 @@ catch(const std::exception & e)
     return EXIT_FAILURE;
 }
 
-void metadata_to_csv(const rs2::frame& frm, const std::string& filename)
+int capture_to_ring(const std::string& file, size_t slots, int seconds)
 {
-    std::ofstream csv;
+    rs2::pipeline pipe;
+    pipe.start();
 
-    csv.open(filename);
+    // Let autoexposure settle, and size the slots for the largest frame
+    size_t slot_size = 0;
+    for (auto i = 0; i < 30; ++i)
+        for (auto&& frame : pipe.wait_for_frames())
+            slot_size = std::max(slot_size, size_t(frame.get_data_size()));
+    pipe.stop();
+
+    // Capture straight into the mapped file: the callback only copies each frame into the next slot
+    rs2::capture_ring ring(file, slots, slot_size);
+    pipe.start(ring);
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    pipe.stop();
+
+    auto stats = ring.get_statistics();
+    std::cout << "Captured " << stats.written << " frames, the last " << std::min<uint64_t>(stats.written, slots)
+              << " are in " << file << std::endl;
+    return EXIT_SUCCESS;
+}
 
-    //    std::cout << "Writing metadata to " << filename << endl;
-    csv << "Stream," << rs2_stream_to_string(frm.get_profile().stream_type()) << "\nMetadata Attribute,Value\n";
+// Write the pixels of a slot: 8-bit color and infrared formats as PNG, depth as CSV of depth units
+static bool slot_to_file(const rs2::capture_ring::slot_header& h, const void* data, const std::string& name)
+{
+    auto format = rs2_format(h.format);
+    auto pixels = static_cast<const uint8_t*>(data);
+    if (format == RS2_FORMAT_Z16)
+    {
+        std::ofstream csv(name + ".csv");
+        csv << "Depth units," << h.depth_units << "\n";
+        for (int y = 0; y < h.height; ++y)
+        {
+            auto row = reinterpret_cast<const uint16_t*>(pixels + y * h.stride);
+            for (int x = 0; x < h.width; ++x) csv << row[x] << (x + 1 < h.width ? "," : "\n");
+        }
+        return bool(csv);
+    }
+    if (format == RS2_FORMAT_BGR8 || format == RS2_FORMAT_BGRA8)
+    {
+        // stb writes RGB order
+        std::vector<uint8_t> rgb(size_t(h.width) * h.height * h.bpp);
+        for (int y = 0; y < h.height; ++y)
+            for (int x = 0; x < h.width; ++x)
+            {
+                auto src = pixels + y * h.stride + x * h.bpp;
+                auto dst = &rgb[(size_t(y) * h.width + x) * h.bpp];
+                memcpy(dst, src, h.bpp);
+                std::swap(dst[0], dst[2]);
+            }
+        return stbi_write_png((name + ".png").c_str(), h.width, h.height, h.bpp, rgb.data(), h.width * h.bpp) != 0;
+    }
+    if (format == RS2_FORMAT_RGB8 || format == RS2_FORMAT_RGBA8 || format == RS2_FORMAT_Y8)
+        return stbi_write_png((name + ".png").c_str(), h.width, h.height, h.bpp, pixels, h.stride) != 0;
+    return false;
+}
 
-    // Record all the available metadata attributes
-    for (size_t i = 0; i < RS2_FRAME_METADATA_COUNT; i++)
+int convert_ring(const std::string& file, const std::string& directory)
+{
+    auto ring = rs2::capture_ring::open(file);
+    auto slots = ring.captured();
+
+    // One metadata row per frame, in capture order
+    std::ofstream csv(directory + "/metadata.csv");
+    csv << "Stream,Index,Frame Number,Timestamp";
+    for (int m = 0; m < RS2_FRAME_METADATA_COUNT; ++m)
+        csv << "," << rs2_frame_metadata_to_string(rs2_frame_metadata_value(m));
+    csv << "\n";
+    for (auto slot : slots)
     {
-        if (frm.supports_frame_metadata((rs2_frame_metadata_value)i))
+        auto& h = ring.header(slot);
+        csv << rs2_stream_to_string(rs2_stream(h.stream)) << "," << h.index << "," << h.frame_number << ","
+            << std::fixed << h.timestamp << std::defaultfloat;
+        for (int m = 0; m < RS2_FRAME_METADATA_COUNT; ++m)
         {
-            csv << rs2_frame_metadata_to_string((rs2_frame_metadata_value)i) << ","
-                << frm.get_frame_metadata((rs2_frame_metadata_value)i) << "\n";
+            csv << ",";
+            if (h.supports(rs2_frame_metadata_value(m))) csv << h.metadata[m];
         }
+        csv << "\n";
     }
 
-    csv.close();
+    // Images are encoded in parallel, one slot at a time per core
+    std::atomic<size_t> next(0);
+    std::atomic<size_t> written(0);
+    auto work = [&]() {
+        for (size_t i = next++; i < slots.size(); i = next++)
+        {
+            auto& h = ring.header(slots[i]);
+            std::stringstream name;
+            name << directory << "/" << rs2_stream_to_string(rs2_stream(h.stream)) << "-" << h.index << "-" << h.frame_number;
+            if (slot_to_file(h, ring.data(slots[i]), name.str())) ++written;
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned t = 1; t < std::max(1u, std::thread::hardware_concurrency()); ++t)
+        workers.emplace_back(work);
+    work();
+    for (auto& w : workers) w.join();
+
+    std::cout << "Converted " << written << " of " << slots.size() << " frames from " << file << " to " << directory << std::endl;
+    return EXIT_SUCCESS;
 }
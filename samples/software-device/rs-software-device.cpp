@@ -3,6 +3,7 @@
 
 #include <librealsense2/rs.hpp> // Include RealSense Cross Platform API
 #include <librealsense2/hpp/rs_internal.hpp>
+#include <librealsense2/hpp/rs_bounded_syncer.hpp>
 #include "example.hpp"
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
@@ -147,7 +148,10 @@ int main(int argc, char * argv[]) try
                                 RS2_FORMAT_RGBA8, color_intrinsics });
 
     dev.create_matcher( RS2_MATCHER_DEFAULT );  // Compare all streams according to timestamp
-    rs2::syncer sync;
+
+    // Frames are matched by timestamp, but no frame waits more than 10 milliseconds for its partner:
+    // after that it is released on its own, so a late color frame never holds depth back
+    rs2::bounded_syncer sync(10.f);
 
     depth_sensor.open(depth_stream);
     color_sensor.open(color_stream);
@@ -162,7 +166,7 @@ int main(int argc, char * argv[]) try
         synthetic_frame& depth_frame = app_data.get_synthetic_depth(app_state);
 
         // The timestamp jumps are closely correlated to the FPS passed above to the video streams:
-        // syncer expects frames to arrive every 1000/FPS milliseconds!
+        // the syncer matches frames whose timestamps are within half a frame interval (1000/FPS/2 milliseconds)
         rs2_time_t timestamp = (rs2_time_t)frame_number * 16;
         auto domain = RS2_TIMESTAMP_DOMAIN_HARDWARE_CLOCK;
 
@@ -183,19 +187,24 @@ int main(int argc, char * argv[]) try
 
         ++frame_number;
 
-        rs2::frameset fset = sync.wait_for_frames();
+        rs2::frameset fset;
+        bool partial = false;
+        if (!sync.try_wait_for_frames(&fset, &partial))
+            continue;
         rs2::frame depth = fset.first_or_default(RS2_STREAM_DEPTH);
         rs2::frame color = fset.first_or_default(RS2_STREAM_COLOR);
         // We cannot expect the syncer to always output both depth and color -- especially on the
         // first few frames! Hiccups can always occur: OS stalls, processing demands, etc...
-        if (depth && color)
+        // Such framesets are flagged as partial; the point cloud is still updated from depth alone,
+        // keeping the texture of the last complete frameset
+        if (auto as_depth = depth.as<rs2::depth_frame>())
         {
-            if (auto as_depth = depth.as<rs2::depth_frame>())
-            {
+            if (!partial && color)
                 pc.map_to(color);
-                points = pc.calculate(as_depth);
-            }
-
+            points = pc.calculate(as_depth);
+        }
+        if (!partial && color)
+        {
             // Upload the color frame to OpenGL
             app_state.tex.upload(color);
         }